@@ -0,0 +1,531 @@
+/* Analyze a heap snapshot written by `dump-heap-snapshot'.
+   Copyright (C) 2018 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
+
+
+/* Usage: heap-analyze [-n COUNT] SNAPSHOT
+
+   Print the number and total size of the objects of each type in
+   SNAPSHOT, then the COUNT objects (default 20) that retain the most
+   memory.  The retained size of an object is the size of everything
+   that would become garbage if that object alone were freed, that is,
+   of the subtree it heads in the dominator tree of the object graph.
+   Dominators are computed with the iterative algorithm of Cooper,
+   Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+
+   The snapshot format is described in src/alloc.c.  */
+
+#include <config.h>
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <binary-io.h>
+#include <unlocked-io.h>
+
+#define SNAPSHOT_MAGIC "EHEAPSN1"
+
+static char const *const root_kind_names[] =
+  {
+    "staticpro", "symbol", "buffer", "thread", "pinned", "terminal",
+    "kboard", "regexp-cache"
+  };
+
+struct object
+{
+  uint64_t address;
+  uint64_t size;
+  uint64_t retained;
+
+  /* Indexes into the REFS array.  */
+  size_t first_ref, nrefs;
+
+  /* Offset of the label in LABELS, and its length.  */
+  size_t label, label_len;
+
+  int type;
+
+  /* Root kind plus one, or zero if this is not a root.  */
+  int root;
+};
+
+static char *progname;
+static char const *filename;
+static FILE *in;
+
+/* Object 0 is a synthetic root that refers to all the real roots.  */
+static struct object *objects;
+static size_t nobjects, objects_size;
+
+/* While reading, the addresses that each object refers to.  After
+   resolve_refs, the indexes of the objects they name.  */
+static uint64_t *refs;
+static size_t nrefs, refs_size;
+
+static char *labels;
+static size_t labels_len, labels_size;
+
+static char *type_names[UCHAR_MAX + 1];
+static int ntypes;
+
+static uint64_t *roots;
+static int *root_kinds;
+static size_t nroots, roots_size, root_kinds_size;
+
+static _Noreturn void
+fatal (char const *message)
+{
+  fprintf (stderr, "%s: %s: %s\n", progname, filename, message);
+  exit (EXIT_FAILURE);
+}
+
+static void *
+xrealloc (void *ptr, size_t *size, size_t needed, size_t elt_size)
+{
+  if (needed <= *size)
+    return ptr;
+  size_t new_size = *size ? *size : 1024;
+  while (new_size < needed)
+    new_size *= 2;
+  if (SIZE_MAX / elt_size < new_size
+      || ! (ptr = realloc (ptr, new_size * elt_size)))
+    {
+      fprintf (stderr, "%s: memory exhausted\n", progname);
+      exit (EXIT_FAILURE);
+    }
+  *size = new_size;
+  return ptr;
+}
+
+static uint64_t
+get (int bytes)
+{
+  uint64_t n = 0;
+  for (int i = 0; i < bytes; i++)
+    {
+      int c = getc (in);
+      if (c == EOF)
+	fatal ("truncated snapshot");
+      n |= (uint64_t) c << (8 * i);
+    }
+  return n;
+}
+
+static void
+read_bytes (char *buf, size_t n)
+{
+  if (fread (buf, 1, n, in) != n)
+    fatal ("truncated snapshot");
+}
+
+static void
+read_snapshot (void)
+{
+  char magic[sizeof SNAPSHOT_MAGIC - 1];
+
+  read_bytes (magic, sizeof magic);
+  if (memcmp (magic, SNAPSHOT_MAGIC, sizeof magic) != 0)
+    fatal ("not a heap snapshot");
+
+  ntypes = get (1);
+  for (int i = 0; i < ntypes; i++)
+    {
+      int len = get (1);
+      type_names[i] = malloc (len + 1);
+      if (!type_names[i])
+	fatal ("memory exhausted");
+      read_bytes (type_names[i], len);
+      type_names[i][len] = '\0';
+    }
+
+  objects = xrealloc (objects, &objects_size, 1, sizeof *objects);
+  memset (&objects[0], 0, sizeof objects[0]);
+  nobjects = 1;
+
+  for (;;)
+    switch (getc (in))
+      {
+      case 'R':
+	roots = xrealloc (roots, &roots_size, nroots + 1, sizeof *roots);
+	root_kinds = xrealloc (root_kinds, &root_kinds_size, nroots + 1,
+			       sizeof *root_kinds);
+	root_kinds[nroots] = get (1);
+	roots[nroots++] = get (8);
+	break;
+
+      case 'O':
+	{
+	  struct object *o;
+	  objects = xrealloc (objects, &objects_size, nobjects + 1,
+			      sizeof *objects);
+	  o = &objects[nobjects++];
+	  o->address = get (8);
+	  o->type = get (1);
+	  if (ntypes <= o->type)
+	    fatal ("bad object type");
+	  o->size = get (8);
+	  o->retained = 0;
+	  o->root = 0;
+	  o->nrefs = get (4);
+	  o->first_ref = nrefs;
+	  refs = xrealloc (refs, &refs_size, nrefs + o->nrefs, sizeof *refs);
+	  for (size_t i = 0; i < o->nrefs; i++)
+	    refs[nrefs++] = get (8);
+	  o->label_len = get (2);
+	  o->label = labels_len;
+	  labels = xrealloc (labels, &labels_size, labels_len + o->label_len,
+			     sizeof *labels);
+	  read_bytes (labels + labels_len, o->label_len);
+	  labels_len += o->label_len;
+	}
+	break;
+
+      case 'E':
+	return;
+
+      case EOF:
+	fatal ("truncated snapshot");
+
+      default:
+	fatal ("bad record");
+      }
+}
+
+/* An open-addressing table from addresses to object indexes.  */
+
+static size_t *index_table;
+static size_t index_mask;
+
+static size_t
+hash_address (uint64_t address)
+{
+  return (address >> 3) * 0x9e3779b97f4a7c15u & index_mask;
+}
+
+static void
+build_index (void)
+{
+  size_t size = 16;
+  while (size < 2 * nobjects)
+    size *= 2;
+  index_table = calloc (size, sizeof *index_table);
+  if (!index_table)
+    fatal ("memory exhausted");
+  index_mask = size - 1;
+  for (size_t i = 1; i < nobjects; i++)
+    {
+      size_t h = hash_address (objects[i].address);
+      while (index_table[h])
+	h = (h + 1) & index_mask;
+      index_table[h] = i;
+    }
+}
+
+/* Return the index of the object at ADDRESS, or 0 if there is none.  */
+
+static size_t
+lookup (uint64_t address)
+{
+  for (size_t h = hash_address (address); index_table[h];
+       h = (h + 1) & index_mask)
+    if (objects[index_table[h]].address == address)
+      return index_table[h];
+  return 0;
+}
+
+/* Replace addresses in REFS by object indexes, dropping references to
+   objects missing from the snapshot, and make the roots the references
+   of object 0.  */
+
+static void
+resolve_refs (void)
+{
+  for (size_t i = 1; i < nobjects; i++)
+    {
+      struct object *o = &objects[i];
+      size_t n = 0;
+      for (size_t j = 0; j < o->nrefs; j++)
+	{
+	  size_t k = lookup (refs[o->first_ref + j]);
+	  if (k)
+	    refs[o->first_ref + n++] = k;
+	}
+      o->nrefs = n;
+    }
+
+  refs = xrealloc (refs, &refs_size, nrefs + nroots, sizeof *refs);
+  objects[0].first_ref = nrefs;
+  for (size_t i = 0; i < nroots; i++)
+    {
+      size_t k = lookup (roots[i]);
+      if (k)
+	{
+	  if (!objects[k].root)
+	    objects[k].root = root_kinds[i] + 1;
+	  refs[nrefs + objects[0].nrefs++] = k;
+	}
+    }
+  nrefs += objects[0].nrefs;
+}
+
+/* The reverse postorder number of each object, the objects in reverse
+   postorder, and the immediate dominator of each object.  Objects
+   that are not reachable from object 0 have order SIZE_MAX.  */
+static size_t *order, *by_order, *idom;
+static size_t nreachable;
+
+static void
+number_objects (void)
+{
+  size_t *stack = malloc (nobjects * sizeof *stack);
+  size_t *next = calloc (nobjects, sizeof *next);
+  size_t sp = 0, n = 0;
+
+  order = malloc (nobjects * sizeof *order);
+  by_order = malloc (nobjects * sizeof *by_order);
+  if (!stack || !next || !order || !by_order)
+    fatal ("memory exhausted");
+  for (size_t i = 0; i < nobjects; i++)
+    order[i] = SIZE_MAX;
+
+  /* An iterative depth-first search; NEXT[I] is the number of
+     references of I already followed.  ORDER[I] is SIZE_MAX - 1 while
+     I is on the stack.  */
+  stack[sp++] = 0;
+  order[0] = SIZE_MAX - 1;
+  while (sp)
+    {
+      size_t i = stack[sp - 1];
+      struct object *o = &objects[i];
+      if (next[i] < o->nrefs)
+	{
+	  size_t k = refs[o->first_ref + next[i]++];
+	  if (order[k] == SIZE_MAX)
+	    {
+	      order[k] = SIZE_MAX - 1;
+	      stack[sp++] = k;
+	    }
+	}
+      else
+	{
+	  sp--;
+	  by_order[n++] = i;
+	}
+    }
+
+  /* BY_ORDER is in postorder; reverse it.  */
+  for (size_t i = 0; i < n / 2; i++)
+    {
+      size_t t = by_order[i];
+      by_order[i] = by_order[n - 1 - i];
+      by_order[n - 1 - i] = t;
+    }
+  for (size_t i = 0; i < n; i++)
+    order[by_order[i]] = i;
+  nreachable = n;
+  free (stack);
+  free (next);
+}
+
+static size_t
+intersect (size_t a, size_t b)
+{
+  while (a != b)
+    {
+      while (order[a] > order[b])
+	a = idom[a];
+      while (order[b] > order[a])
+	b = idom[b];
+    }
+  return a;
+}
+
+static void
+compute_dominators (void)
+{
+  /* Predecessor lists, in compressed form.  */
+  size_t *pred_start = calloc (nobjects + 1, sizeof *pred_start);
+  size_t *preds = malloc ((nrefs ? nrefs : 1) * sizeof *preds);
+  size_t *fill = calloc (nobjects, sizeof *fill);
+  idom = malloc (nobjects * sizeof *idom);
+  if (!pred_start || !preds || !fill || !idom)
+    fatal ("memory exhausted");
+
+  for (size_t i = 0; i < nobjects; i++)
+    for (size_t j = 0; j < objects[i].nrefs; j++)
+      pred_start[refs[objects[i].first_ref + j] + 1]++;
+  for (size_t i = 0; i < nobjects; i++)
+    pred_start[i + 1] += pred_start[i];
+  for (size_t i = 0; i < nobjects; i++)
+    for (size_t j = 0; j < objects[i].nrefs; j++)
+      {
+	size_t k = refs[objects[i].first_ref + j];
+	preds[pred_start[k] + fill[k]++] = i;
+      }
+  free (fill);
+
+  for (size_t i = 0; i < nobjects; i++)
+    idom[i] = SIZE_MAX;
+  idom[0] = 0;
+
+  bool changed = true;
+  while (changed)
+    {
+      changed = false;
+      for (size_t n = 1; n < nreachable; n++)
+	{
+	  size_t b = by_order[n];
+	  size_t new_idom = SIZE_MAX;
+	  for (size_t p = pred_start[b]; p < pred_start[b + 1]; p++)
+	    {
+	      size_t q = preds[p];
+	      if (idom[q] == SIZE_MAX)
+		continue;
+	      new_idom = new_idom == SIZE_MAX ? q : intersect (q, new_idom);
+	    }
+	  if (idom[b] != new_idom)
+	    {
+	      idom[b] = new_idom;
+	      changed = true;
+	    }
+	}
+    }
+
+  free (pred_start);
+  free (preds);
+
+  /* Children come after their dominators in reverse postorder, so one
+     backward pass sums the retained sizes.  */
+  for (size_t n = nreachable; 0 < n--; )
+    {
+      size_t b = by_order[n];
+      objects[b].retained += objects[b].size;
+      if (b)
+	objects[idom[b]].retained += objects[b].retained;
+    }
+}
+
+static void
+print_object (size_t i)
+{
+  struct object *o = &objects[i];
+  printf ("%12"PRIu64" %12"PRIu64"  %#"PRIx64" %s",
+	  o->retained, o->size, o->address, type_names[o->type]);
+  if (o->label_len)
+    printf (" %.*s", (int) o->label_len, labels + o->label);
+  if (o->root)
+    printf (" [%s root]",
+	    (o->root - 1 < sizeof root_kind_names / sizeof *root_kind_names
+	     ? root_kind_names[o->root - 1] : "unknown"));
+  putchar ('\n');
+}
+
+static int
+compare_retained (void const *a, void const *b)
+{
+  uint64_t x = objects[*(size_t const *) a].retained;
+  uint64_t y = objects[*(size_t const *) b].retained;
+  return (x < y) - (x > y);
+}
+
+static uint64_t type_bytes[UCHAR_MAX + 1];
+static size_t type_counts[UCHAR_MAX + 1];
+
+static int
+compare_type_bytes (void const *a, void const *b)
+{
+  uint64_t x = type_bytes[*(int const *) a];
+  uint64_t y = type_bytes[*(int const *) b];
+  return (x < y) - (x > y);
+}
+
+static void
+report (size_t top)
+{
+  int by_type[UCHAR_MAX + 1];
+  uint64_t total = 0;
+
+  for (size_t i = 1; i < nobjects; i++)
+    {
+      type_bytes[objects[i].type] += objects[i].size;
+      type_counts[objects[i].type]++;
+      total += objects[i].size;
+    }
+  for (int t = 0; t < ntypes; t++)
+    by_type[t] = t;
+  qsort (by_type, ntypes, sizeof *by_type, compare_type_bytes);
+
+  printf ("%zu objects, %"PRIu64" bytes\n\n", nobjects - 1, total);
+  printf ("%12s %12s  %s\n", "count", "bytes", "type");
+  for (int t = 0; t < ntypes; t++)
+    if (type_counts[by_type[t]])
+      printf ("%12zu %12"PRIu64"  %s\n", type_counts[by_type[t]],
+	      type_bytes[by_type[t]], type_names[by_type[t]]);
+
+  size_t *sorted = malloc (nobjects * sizeof *sorted);
+  if (!sorted)
+    fatal ("memory exhausted");
+  for (size_t i = 1; i < nobjects; i++)
+    sorted[i - 1] = i;
+  qsort (sorted, nobjects - 1, sizeof *sorted, compare_retained);
+
+  printf ("\n%12s %12s  %s\n", "retained", "self", "object");
+  for (size_t i = 0; i < top && i < nobjects - 1; i++)
+    print_object (sorted[i]);
+  free (sorted);
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t top = 20;
+
+  progname = argv[0];
+  for (argv++; *argv && (*argv)[0] == '-'; argv++)
+    {
+      if (!strcmp (*argv, "-n") && argv[1])
+	top = strtoul (*++argv, NULL, 10);
+      else
+	{
+	  fprintf (stderr, "usage: %s [-n COUNT] SNAPSHOT\n", progname);
+	  return EXIT_FAILURE;
+	}
+    }
+  if (!*argv || argv[1])
+    {
+      fprintf (stderr, "usage: %s [-n COUNT] SNAPSHOT\n", progname);
+      return EXIT_FAILURE;
+    }
+
+  filename = *argv;
+  in = fopen (filename, "rb");
+  if (!in)
+    {
+      perror (filename);
+      return EXIT_FAILURE;
+    }
+  read_snapshot ();
+  fclose (in);
+
+  build_index ();
+  resolve_refs ();
+  number_objects ();
+  compute_dominators ();
+  report (top);
+  return EXIT_SUCCESS;
+}
@@ -61,7 +61,7 @@
     (overlay atom) (float number atom) (window-configuration atom)
     (process atom) (window atom) (subr atom) (compiled-function function atom)
     (module-function function atom)
-    (buffer atom) (char-table array sequence atom)
+    (buffer atom) (buffer-snapshot atom) (char-table array sequence atom)
     (bool-vector array sequence atom)
     (frame atom) (hash-table atom) (terminal atom)
     (thread atom) (mutex atom) (condvar atom)
@@ -311,13 +311,14 @@ pub fn md5(
     )
 }
 
-/// Return the secure hash of OBJECT, a buffer or string.
+/// Return the secure hash of OBJECT, a buffer, buffer snapshot or string.
 /// ALGORITHM is a symbol specifying the hash to use:
 /// md5, sha1, sha224, sha256, sha384 or sha512.
 ///
 /// The two optional arguments START and END are positions specifying for
 /// which part of OBJECT to compute the hash.  If nil or omitted, uses the
-/// whole OBJECT.
+/// whole OBJECT.  For a snapshot made by `buffer-snapshot', they are
+/// positions in the buffer as it was when the snapshot was made.
 ///
 /// The full list of algorithms can be obtained with `secure-hash-algorithms'.
 ///
@@ -26,13 +26,13 @@ use crate::{
     remacs_sys::{Fdelete, Ffset, Fget, Fpurecopy},
     remacs_sys::{Lisp_Buffer, Lisp_Subr_Lang},
     remacs_sys::{
-        Qargs_out_of_range, Qarrayp, Qautoload, Qbool_vector, Qbuffer, Qchar_table, Qchoice,
-        Qcompiled_function, Qcondition_variable, Qcons, Qcyclic_function_indirection,
-        Qdefalias_fset_function, Qdefun, Qfinalizer, Qfloat, Qfont, Qfont_entity, Qfont_object,
-        Qfont_spec, Qframe, Qfunction_documentation, Qhash_table, Qinteger, Qmany, Qmarker,
-        Qmodule_function, Qmutex, Qnil, Qnone, Qoverlay, Qprocess, Qrange, Qstring, Qsubr, Qsymbol,
-        Qt, Qterminal, Qthread, Qunbound, Qunevalled, Quser_ptr, Qvector, Qvoid_variable,
-        Qwatchers, Qwindow, Qwindow_configuration,
+        Qargs_out_of_range, Qarrayp, Qautoload, Qbool_vector, Qbuffer, Qbuffer_snapshot,
+        Qchar_table, Qchoice, Qcompiled_function, Qcondition_variable, Qcons,
+        Qcyclic_function_indirection, Qdefalias_fset_function, Qdefun, Qfinalizer, Qfloat, Qfont,
+        Qfont_entity, Qfont_object, Qfont_spec, Qframe, Qfunction_documentation, Qhash_table,
+        Qinteger, Qmany, Qmarker, Qmodule_function, Qmutex, Qnil, Qnone, Qoverlay, Qprocess, Qrange,
+        Qstring, Qsubr, Qsymbol, Qt, Qterminal, Qthread, Qunbound, Qunevalled, Quser_ptr, Qvector,
+        Qvoid_variable, Qwatchers, Qwindow, Qwindow_configuration,
     },
     symbols::LispSymbolRef,
     threads::ThreadState,
@@ -121,6 +121,7 @@ pub fn type_of(object: LispObject) -> LispObject {
                 pvec_type::PVEC_SUBR => Qsubr,
                 pvec_type::PVEC_COMPILED => Qcompiled_function,
                 pvec_type::PVEC_BUFFER => Qbuffer,
+                pvec_type::PVEC_BUFFER_SNAPSHOT => Qbuffer_snapshot,
                 pvec_type::PVEC_CHAR_TABLE => Qchar_table,
                 pvec_type::PVEC_BOOL_VECTOR => Qbool_vector,
                 pvec_type::PVEC_FRAME => Qframe,
@@ -8,7 +8,7 @@ use crate::{
     lisp::defsubr,
     lisp::LispObject,
     remacs_sys::{globals, EmacsInt, EmacsUint, Lisp_Cons, Lisp_Type},
-    remacs_sys::{Fcons, CHECK_IMPURE},
+    remacs_sys::{cons_list, Fcons, CHECK_IMPURE},
     remacs_sys::{Qcircular_list, Qconsp, Qlistp, Qnil, Qplistp},
     symbols::LispSymbolRef,
 };
@@ -702,9 +702,7 @@ pub fn put(mut symbol: LispSymbolRef, propname: LispObject, value: LispObject) -
 /// usage: (fn &rest OBJECTS)
 #[lisp_fn]
 pub fn list(args: &[LispObject]) -> LispObject {
-    args.iter()
-        .rev()
-        .fold(Qnil, |list, &arg| LispObject::cons(arg, list))
+    unsafe { cons_list(args.len() as isize, args.as_ptr(), Qnil) }
 }
 
 /// Return a newly created list of length LENGTH, with each element being INIT.
@@ -10,7 +10,7 @@ use crate::{
     buffers::{current_buffer, LispBufferRef},
     lisp::{defsubr, ExternalPtr, LispObject},
     multibyte::multibyte_chars_in_text,
-    remacs_sys::{allocate_misc, set_point_both, Fmake_marker},
+    remacs_sys::{allocate_misc, charpos_index_lookup, set_point_both, Fmake_marker},
     remacs_sys::{EmacsInt, Lisp_Buffer, Lisp_Marker, Lisp_Misc_Type},
     remacs_sys::{Qinteger_or_marker_p, Qmarkerp, Qnil},
     threads::ThreadState,
@@ -25,6 +25,14 @@ const MARKER_DEBUG: bool = true;
 #[cfg(not(MARKER_DEBUG))]
 const MARKER_DEBUG: bool = false;
 
+// The buffer's markers double as a cache of known charpos/bytepos
+// pairs, but a buffer can have tens of thousands of them.  While
+// looking for a close enough pair, accept a wider and wider range the
+// more markers we have examined, so that the scan over the markers
+// never costs more than the scan over the text it is meant to save.
+const BYTECHAR_DISTANCE_INITIAL: isize = 100;
+const BYTECHAR_DISTANCE_INCREMENT: isize = 50;
+
 impl LispMarkerRef {
     pub fn as_lisp_obj(self) -> LispObject {
         unsafe { mem::transmute(self.as_ptr()) }
@@ -655,14 +663,33 @@ pub unsafe extern "C" fn buf_charpos_to_bytepos(b: *mut Lisp_Buffer, charpos: is
         consider_known!(buffer_ref.cached_charpos, buffer_ref.cached_bytepos);
     }
 
+    let (mut cp_below, mut bp_below, mut cp_above, mut bp_above): (isize, isize, isize, isize) =
+        (0, 0, 0, 0);
+    if charpos_index_lookup(
+        b,
+        false,
+        charpos,
+        best_below,
+        best_above,
+        &mut cp_below,
+        &mut bp_below,
+        &mut cp_above,
+        &mut bp_above,
+    ) {
+        consider_known!(cp_below, bp_below);
+        consider_known!(cp_above, bp_above);
+    }
+
+    let mut distance = BYTECHAR_DISTANCE_INITIAL;
     for m in buffer_ref.markers().iter() {
         consider_known!(m.charpos_or_error(), m.bytepos_or_error());
-        // If we are down to a range of 50 chars,
+        // If we are down to a range of DISTANCE chars,
         // don't bother checking any other markers;
         // scan the intervening chars directly now.
-        if best_above - best_below < 50 {
+        if best_above - best_below < distance {
             break;
         }
+        distance += BYTECHAR_DISTANCE_INCREMENT;
     }
 
     if charpos - best_below < best_above - charpos {
@@ -766,14 +793,33 @@ pub unsafe extern "C" fn buf_bytepos_to_charpos(b: *mut Lisp_Buffer, bytepos: is
         consider_known!(buffer_ref.cached_bytepos, buffer_ref.cached_charpos);
     }
 
+    let (mut cp_below, mut bp_below, mut cp_above, mut bp_above): (isize, isize, isize, isize) =
+        (0, 0, 0, 0);
+    if charpos_index_lookup(
+        b,
+        true,
+        bytepos,
+        best_below_byte,
+        best_above_byte,
+        &mut cp_below,
+        &mut bp_below,
+        &mut cp_above,
+        &mut bp_above,
+    ) {
+        consider_known!(bp_below, cp_below);
+        consider_known!(bp_above, cp_above);
+    }
+
+    let mut distance = BYTECHAR_DISTANCE_INITIAL;
     for m in buffer_ref.markers().iter() {
         consider_known!(m.bytepos_or_error(), m.charpos_or_error());
-        // If we are down to a range of 50 chars,
+        // If we are down to a range of DISTANCE chars,
         // don't bother checking any other markers;
         // scan the intervening chars directly now.
-        if best_above - best_below < 50 {
+        if best_above - best_below < distance {
             break;
         }
+        distance += BYTECHAR_DISTANCE_INCREMENT;
     }
 
     // We get here if we did not exactly hit one of the known places.
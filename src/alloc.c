@@ -31,6 +31,7 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #endif
 
 #include "lisp.h"
+#include "remacs-lib.h"
 #include "dispextern.h"
 #include "intervals.h"
 #include "ptr-bounds.h"
@@ -43,6 +44,8 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #include "keyboard.h"
 #include "frame.h"
 #include "blockinput.h"
+#include "coding.h"
+#include "sysstdio.h"
 #include "termhooks.h"		/* For struct terminal.  */
 #ifdef HAVE_WINDOW_SYSTEM
 #include TERM_HEADER
@@ -60,6 +63,15 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 # include <malloc.h>
 #endif
 
+/* Whether malloc_trim can give the memory of the blocks that Lisp
+   data used to occupy back to the OS.  It cannot if the blocks come
+   from gmalloc.  */
+#if (defined HAVE_MALLOC_TRIM \
+     && (defined SYSTEM_MALLOC || defined HYBRID_MALLOC \
+	 || defined DOUG_LEA_MALLOC))
+# define USE_MALLOC_TRIM 1
+#endif
+
 #if (defined ENABLE_CHECKING			\
      && defined HAVE_VALGRIND_VALGRIND_H	\
      && !defined USE_VALGRIND)
@@ -246,6 +258,10 @@ static EMACS_INT total_conses, total_markers, total_symbols, total_buffers;
 static EMACS_INT total_free_conses, total_free_markers, total_free_symbols;
 static EMACS_INT total_free_floats, total_floats;
 
+/* Number of conses given back by free_cons rather than by a GC.  */
+
+static EMACS_INT conses_freed_outside_gc;
+
 /* Points to memory space allocated as "spare", to be freed if we run
    out of memory.  We keep one large block, four cons-blocks, and
    two string blocks.  */
@@ -351,8 +367,37 @@ no_sanitize_memcpy (void *dest, void const *src, size_t size)
 
 #endif /* MAX_SAVE_STACK > 0 */
 
+/* The phases of a garbage collection that are timed separately; see
+   `garbage-collect-statistics'.  Marking done from a phase, via
+   mark_object, is charged to that phase.  */
+
+enum gc_phase
+  {
+    /* Static roots, buffers, symbols, terminals and keyboards.  */
+    GC_PHASE_ROOTS,
+    /* C stacks and specpdls of all threads.  */
+    GC_PHASE_STACK,
+    /* Font caches, undo lists and finalizers, marked last.  */
+    GC_PHASE_LATE_MARK,
+    /* sweep_weak_hash_tables.  */
+    GC_PHASE_WEAK_TABLES,
+    /* The rest of gc_sweep, except for...  */
+    GC_PHASE_SWEEP,
+    /* ...compact_small_strings.  */
+    GC_PHASE_COMPACT_STRINGS,
+    /* Running the finalizers of dead objects.  */
+    GC_PHASE_FINALIZERS,
+    /* Giving free memory back to the OS.  */
+    GC_PHASE_TRIM,
+    GC_PHASES
+  };
+
+static void gc_phase_end (enum gc_phase);
 static void mark_terminals (void);
 static void gc_sweep (void);
+static void shrink_mark_stack (void);
+static void finish_lazy_sweep (void);
+static bool trim_heap (void);
 static Lisp_Object make_pure_vector (ptrdiff_t);
 static void mark_buffer (struct buffer *);
 
@@ -463,6 +508,8 @@ static void mem_rotate_right (struct mem_node *);
 static void mem_delete (struct mem_node *);
 static void mem_delete_fixup (struct mem_node *);
 static struct mem_node *mem_find (void *);
+static void ablock_map_insert (struct mem_node *);
+static void ablock_map_remove (void *);
 
 #ifndef DEADP
 # define DEADP(x) 0
@@ -1054,6 +1101,12 @@ record_xmalloc (size_t size)
 }
 
 
+/* Number of bytes of Lisp data blocks given back to malloc so far,
+   and the value it had when malloc_trim was last called.  Blocks of
+   type MEM_TYPE_NON_LISP are counted by the code that frees them.  */
+
+static EMACS_INT bytes_released, bytes_released_at_trim;
+
 /* Like malloc but used for allocating Lisp data.  NBYTES is the
    number of bytes to allocate, TYPE describes the intended use of the
    allocated memory block (for strings, for conses, ...).  */
@@ -1113,7 +1166,10 @@ lisp_free (void *block)
   MALLOC_BLOCK_INPUT;
   free (block);
 #ifndef GC_MALLOC_CHECK
-  mem_delete (mem_find (block));
+  struct mem_node *m = mem_find (block);
+  if (m != MEM_NIL)
+    bytes_released += (char *) m->end - (char *) m->start;
+  mem_delete (m);
 #endif
   MALLOC_UNBLOCK_INPUT;
 }
@@ -1326,7 +1382,7 @@ lisp_align_malloc (size_t nbytes, enum mem_type type)
 
 #ifndef GC_MALLOC_CHECK
   if (type != MEM_TYPE_NON_LISP)
-    mem_insert (val, (char *) val + nbytes, type);
+    ablock_map_insert (mem_insert (val, (char *) val + nbytes, type));
 #endif
 
   MALLOC_UNBLOCK_INPUT;
@@ -1345,7 +1401,9 @@ lisp_align_free (void *block)
 
   MALLOC_BLOCK_INPUT;
 #ifndef GC_MALLOC_CHECK
-  mem_delete (mem_find (block));
+  struct mem_node *m = mem_find (block);
+  ablock_map_remove (block);
+  mem_delete (m);
 #endif
   /* Put on free list.  */
   ablock->x.next_free = free_ablock;
@@ -1378,6 +1436,7 @@ lisp_align_free (void *block)
       eassert ((uintptr_t) ABLOCKS_BASE (abase) % BLOCK_ALIGN == 0);
 #endif
       free (ABLOCKS_BASE (abase));
+      bytes_released += ABLOCKS_BYTES;
     }
   MALLOC_UNBLOCK_INPUT;
 }
@@ -2152,7 +2211,9 @@ sweep_strings (void)
 
   string_blocks = live_blocks;
   free_large_strings ();
+  gc_phase_end (GC_PHASE_SWEEP);
   compact_small_strings ();
+  gc_phase_end (GC_PHASE_COMPACT_STRINGS);
 
   check_string_free_list ();
 }
@@ -2171,7 +2232,15 @@ free_large_strings (void)
       next = b->next;
 
       if (b->data[0].string == NULL)
-	lisp_free (b);
+	{
+	  /* Large sblocks are not in the mem_node tree, so lisp_free
+	     cannot tell how big they were.  */
+	  ptrdiff_t nbytes = SDATA_NBYTES (b->data);
+	  bytes_released += (FLEXSIZEOF (struct sblock, data,
+					 SDATA_SIZE (nbytes))
+			     + GC_STRING_EXTRA);
+	  lisp_free (b);
+	}
       else
 	{
 	  b->next = live_blocks;
@@ -2272,6 +2341,7 @@ compact_small_strings (void)
       for (b = tb->next; b; )
 	{
 	  struct sblock *next = b->next;
+	  bytes_released += SBLOCK_SIZE;
 	  lisp_free (b);
 	  b = next;
 	}
@@ -2580,9 +2650,6 @@ struct float_block
 #define FLOAT_MARK(fptr) \
   SETMARKBIT (FLOAT_BLOCK (fptr), FLOAT_INDEX ((fptr)))
 
-#define FLOAT_UNMARK(fptr) \
-  UNSETMARKBIT (FLOAT_BLOCK (fptr), FLOAT_INDEX ((fptr)))
-
 /* Current float_block.  */
 
 static struct float_block *float_block;
@@ -2595,15 +2662,71 @@ static int float_block_index = FLOAT_BLOCK_SIZE;
 
 static struct Lisp_Float *float_free_list;
 
-/* Return a new float object with value FLOAT_VALUE.  */
+/* First float_block that GC left for lazy sweeping, or NULL.  All the
+   blocks after it on the `next' chain are unswept too.  */
+
+static struct float_block *float_sweep_cursor;
+
+/* Return true if float block B is one of those left for lazy sweeping.
+   The dead floats in such a block are not on the free list yet; only
+   their clear mark bits tell them from the live ones.  */
+
+static bool
+float_block_unswept_p (struct float_block *b)
+{
+  struct float_block *c;
+
+  for (c = float_sweep_cursor; c; c = c->next)
+    if (c == b)
+      return true;
+  return false;
+}
+
+static void lazy_sweep_floats (void);
+
+/* Floats recently returned by make_float, indexed by a hash of their
+   bit pattern.  Numeric code tends to produce the same values over
+   and over (0.0, 1.0, small integers, the same ratios), and since
+   floats are immutable, handing out an existing object for the same
+   bits saves both the allocation and the later sweep.  The cache does
+   not keep its floats alive: garbage_collect_1 clears it before
+   marking.  */
+
+#define FLOAT_CACHE_BITS 8
+#define FLOAT_CACHE_SIZE (1 << FLOAT_CACHE_BITS)
+
+static struct Lisp_Float *float_cache[FLOAT_CACHE_SIZE];
+
+verify (sizeof (double) == sizeof (uint64_t));
+
+static int
+float_cache_index (uint64_t bits)
+{
+  return (bits * 0x9e3779b97f4a7c15u) >> (64 - FLOAT_CACHE_BITS);
+}
+
+/* Return a float object with value FLOAT_VALUE.  It may be shared
+   with earlier calls.  */
 
 Lisp_Object
 make_float (double float_value)
 {
   register Lisp_Object val;
+  uint64_t bits;
+  struct Lisp_Float **slot;
+
+  /* Compare bit patterns rather than values, so that 0.0 and -0.0,
+     and NaNs with different payloads, stay distinct.  */
+  memcpy (&bits, &float_value, sizeof bits);
+  slot = &float_cache[float_cache_index (bits)];
+  if (*slot && memcmp (&(*slot)->u.data, &bits, sizeof bits) == 0)
+    return make_lisp_ptr (*slot, Lisp_Float);
 
   MALLOC_BLOCK_INPUT;
 
+  if (!float_free_list && float_sweep_cursor)
+    lazy_sweep_floats ();
+
   if (float_free_list)
     {
       /* We use the data field for chaining the free list
@@ -2631,6 +2754,7 @@ make_float (double float_value)
 
   XFLOAT_INIT (val, float_value);
   eassert (!FLOAT_MARKED_P (XFLOAT (val)));
+  *slot = XFLOAT (val);
   consing_since_gc += sizeof (struct Lisp_Float);
   floats_consed++;
   total_free_floats--;
@@ -2689,6 +2813,27 @@ static int cons_block_index = CONS_BLOCK_SIZE;
 
 static struct Lisp_Cons *cons_free_list;
 
+/* First cons_block that GC left for lazy sweeping, or NULL.  All the
+   blocks after it on the `next' chain are unswept too.  */
+
+static struct cons_block *cons_sweep_cursor;
+
+/* Return true if cons block B is one of those left for lazy sweeping.
+   Its dead conses do not have Vdead in their car yet.  */
+
+static bool
+cons_block_unswept_p (struct cons_block *b)
+{
+  struct cons_block *c;
+
+  for (c = cons_sweep_cursor; c; c = c->next)
+    if (c == b)
+      return true;
+  return false;
+}
+
+static void lazy_sweep_conses (void);
+
 /* Explicitly free a cons cell by putting it on the free-list.  */
 
 void
@@ -2699,6 +2844,21 @@ free_cons (struct Lisp_Cons *ptr)
   cons_free_list = ptr;
   consing_since_gc -= sizeof *ptr;
   total_free_conses++;
+  conses_freed_outside_gc++;
+}
+
+/* Start a fresh cons block for Fcons and cons_list to carve cells
+   from.  */
+
+static void
+new_cons_block (void)
+{
+  struct cons_block *new = lisp_align_malloc (sizeof *new, MEM_TYPE_CONS);
+  memset (new->gcmarkbits, 0, sizeof new->gcmarkbits);
+  new->next = cons_block;
+  cons_block = new;
+  cons_block_index = 0;
+  total_free_conses += CONS_BLOCK_SIZE;
 }
 
 DEFUN ("cons", Fcons, Scons, 2, 2, 0,
@@ -2709,6 +2869,9 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
 
   MALLOC_BLOCK_INPUT;
 
+  if (!cons_free_list && cons_sweep_cursor)
+    lazy_sweep_conses ();
+
   if (cons_free_list)
     {
       /* We use the cdr for chaining the free list
@@ -2719,15 +2882,7 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
   else
     {
       if (cons_block_index == CONS_BLOCK_SIZE)
-	{
-	  struct cons_block *new
-	    = lisp_align_malloc (sizeof *new, MEM_TYPE_CONS);
-	  memset (new->gcmarkbits, 0, sizeof new->gcmarkbits);
-	  new->next = cons_block;
-	  cons_block = new;
-	  cons_block_index = 0;
-	  total_free_conses += CONS_BLOCK_SIZE;
-	}
+	new_cons_block ();
       XSETCONS (val, &cons_block->conses[cons_block_index]);
       cons_block_index++;
     }
@@ -2743,6 +2898,57 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
   return val;
 }
 
+/* Return a list of the COUNT objects in ARGS, followed by TAIL.
+   This is what COUNT calls to Fcons would do, but the cells are taken
+   from the free list or carved from the current block in a batch, and
+   the allocation counters are updated once for the whole list.  */
+
+Lisp_Object
+cons_list (ptrdiff_t count, Lisp_Object const *args, Lisp_Object tail)
+{
+  Lisp_Object val = tail;
+  ptrdiff_t i = count;
+
+  MALLOC_BLOCK_INPUT;
+
+  while (0 < i)
+    {
+      if (!cons_free_list && cons_sweep_cursor)
+	lazy_sweep_conses ();
+
+      if (cons_free_list)
+	while (cons_free_list && 0 < i)
+	  {
+	    /* The free list is chained through the cdr.  */
+	    struct Lisp_Cons *c = cons_free_list;
+	    cons_free_list = c->u.s.u.chain;
+	    c->u.s.car = args[--i];
+	    c->u.s.u.cdr = val;
+	    XSETCONS (val, c);
+	  }
+      else
+	{
+	  if (cons_block_index == CONS_BLOCK_SIZE)
+	    new_cons_block ();
+	  for (int n = min (i, CONS_BLOCK_SIZE - cons_block_index);
+	       0 < n; n--)
+	    {
+	      struct Lisp_Cons *c = &cons_block->conses[cons_block_index++];
+	      c->u.s.car = args[--i];
+	      c->u.s.u.cdr = val;
+	      XSETCONS (val, c);
+	    }
+	}
+    }
+
+  MALLOC_UNBLOCK_INPUT;
+
+  consing_since_gc += count * sizeof (struct Lisp_Cons);
+  total_free_conses -= count;
+  cons_cells_consed += count;
+  return val;
+}
+
 #ifdef GC_CHECK_CONS_LIST
 /* Get an error now if there's any junk in the cons free list.  */
 void
@@ -2773,22 +2979,24 @@ list2 (Lisp_Object arg1, Lisp_Object arg2)
 Lisp_Object
 list3 (Lisp_Object arg1, Lisp_Object arg2, Lisp_Object arg3)
 {
-  return Fcons (arg1, Fcons (arg2, Fcons (arg3, Qnil)));
+  Lisp_Object args[] = { arg1, arg2, arg3 };
+  return cons_list (ARRAYELTS (args), args, Qnil);
 }
 
 
 Lisp_Object
 list4 (Lisp_Object arg1, Lisp_Object arg2, Lisp_Object arg3, Lisp_Object arg4)
 {
-  return Fcons (arg1, Fcons (arg2, Fcons (arg3, Fcons (arg4, Qnil))));
+  Lisp_Object args[] = { arg1, arg2, arg3, arg4 };
+  return cons_list (ARRAYELTS (args), args, Qnil);
 }
 
 
 Lisp_Object
 list5 (Lisp_Object arg1, Lisp_Object arg2, Lisp_Object arg3, Lisp_Object arg4, Lisp_Object arg5)
 {
-  return Fcons (arg1, Fcons (arg2, Fcons (arg3, Fcons (arg4,
-						       Fcons (arg5, Qnil)))));
+  Lisp_Object args[] = { arg1, arg2, arg3, arg4, arg5 };
+  return cons_list (ARRAYELTS (args), args, Qnil);
 }
 
 /* Make a list of COUNT Lisp_Objects, where ARG is the
@@ -3136,6 +3344,12 @@ cleanup_vector (struct Lisp_Vector *vector)
     finalize_one_mutex ((struct Lisp_Mutex *) vector);
   else if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_CONDVAR))
     finalize_one_condvar ((struct Lisp_CondVar *) vector);
+  else if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_BUFFER_SNAPSHOT))
+    {
+      struct Lisp_Buffer_Snapshot *s = (struct Lisp_Buffer_Snapshot *) vector;
+      xfree (s->text);
+      xfree (s->index);
+    }
 }
 
 /* Reclaim space used by unmarked vectors.  */
@@ -4064,7 +4278,124 @@ refill_memory_reserve (void)
    lisp_free removes it with mem_delete.  Functions live_string_p etc
    call mem_find to lookup information about a given pointer in the
    tree, and use that to determine if the pointer points into a Lisp
-   object or not.  */
+   object or not.
+
+   Blocks allocated by lisp_align_malloc, which hold all conses and
+   floats, are also entered in the ablock map, a hash table indexed by
+   block address.  Since such a block starts at a multiple of
+   BLOCK_ALIGN and nothing else shares its BLOCK_ALIGN bytes, mem_find
+   can find it from any pointer into it with a single probe, and only
+   pointers elsewhere need a tree walk.  */
+
+/* The ablock map, an open-addressing table with linear probing.  Its
+   size is zero or a power of two, and it is kept at most half full.
+   Empty slots are null; the key of an entry is its START.  */
+
+static struct mem_node **ablock_map;
+static ptrdiff_t ablock_map_size;
+static ptrdiff_t ablock_map_count;
+
+/* Return the slot where the search for the block at BLOCK starts.  */
+
+static ptrdiff_t
+ablock_map_home (void *block)
+{
+  return ((uintptr_t) block / BLOCK_ALIGN) & (ablock_map_size - 1);
+}
+
+/* Return the index of the slot holding the block at BLOCK, or of the
+   empty slot where it would go.  The map must not be full.  */
+
+static ptrdiff_t
+ablock_map_slot (void *block)
+{
+  ptrdiff_t i = ablock_map_home (block);
+
+  while (ablock_map[i] && ablock_map[i]->start != block)
+    i = (i + 1) & (ablock_map_size - 1);
+  return i;
+}
+
+/* Return the node of the aligned block containing P, or null.  */
+
+static struct mem_node *
+ablock_map_lookup (void *p)
+{
+  if (ablock_map_count == 0)
+    return NULL;
+  return ablock_map[ablock_map_slot ((void *) ((uintptr_t) p
+					       & ~(BLOCK_ALIGN - 1)))];
+}
+
+/* Enter node M of a newly allocated aligned block in the map.  */
+
+static void
+ablock_map_insert (struct mem_node *m)
+{
+  eassert ((uintptr_t) m->start % BLOCK_ALIGN == 0);
+
+  if (ablock_map_size < 2 * (ablock_map_count + 1))
+    {
+      struct mem_node **old = ablock_map;
+      ptrdiff_t i, old_size = ablock_map_size;
+      ptrdiff_t new_size = old_size ? 2 * old_size : 1024;
+
+      /* Allocate before touching the map, so that it is still intact
+	 if we run out of memory.  */
+      struct mem_node **new = xzalloc (new_size * sizeof *new);
+      ablock_map = new;
+      ablock_map_size = new_size;
+      for (i = 0; i < old_size; i++)
+	if (old[i])
+	  ablock_map[ablock_map_slot (old[i]->start)] = old[i];
+      xfree (old);
+    }
+
+  ablock_map[ablock_map_slot (m->start)] = m;
+  ablock_map_count++;
+}
+
+/* Remove the aligned block at BLOCK from the map.  */
+
+static void
+ablock_map_remove (void *block)
+{
+  ptrdiff_t i, j, mask = ablock_map_size - 1;
+
+  if (ablock_map_count == 0)
+    return;
+  i = ablock_map_slot (block);
+  if (!ablock_map[i])
+    return;
+
+  /* Close the gap, moving back any later entry of the same cluster
+     whose home slot is not between the gap and the entry.  */
+  for (j = (i + 1) & mask; ablock_map[j]; j = (j + 1) & mask)
+    {
+      ptrdiff_t home = ablock_map_home (ablock_map[j]->start);
+      if (i <= j ? (home <= i || j < home) : (home <= i && j < home))
+	{
+	  ablock_map[i] = ablock_map[j];
+	  i = j;
+	}
+    }
+  ablock_map[i] = NULL;
+  ablock_map_count--;
+}
+
+/* Node OLD of an aligned block is being replaced by NEW, which now has
+   the same contents.  Update the map accordingly.  */
+
+static void
+ablock_map_replace (struct mem_node *old, struct mem_node *new)
+{
+  if (ablock_map_count != 0)
+    {
+      ptrdiff_t i = ablock_map_slot (old->start);
+      if (ablock_map[i] == old)
+	ablock_map[i] = new;
+    }
+}
 
 /* Initialize this part of alloc.c.  */
 
@@ -4090,6 +4421,10 @@ mem_find (void *start)
   if (start < min_heap_address || start > max_heap_address)
     return MEM_NIL;
 
+  p = ablock_map_lookup (start);
+  if (p)
+    return start < p->end ? p : MEM_NIL;
+
   /* Make the search always successful to speed up the loop below.  */
   mem_z.start = start;
   mem_z.end = (char *) start + 1;
@@ -4347,6 +4682,7 @@ mem_delete (struct mem_node *z)
       z->start = y->start;
       z->end = y->end;
       z->type = y->type;
+      ablock_map_replace (y, z);
     }
 
   if (y->color == MEM_BLACK)
@@ -4500,7 +4836,8 @@ live_cons_holding (struct mem_node *m, void *p)
 	{
 	  cp = ptr_bounds_copy (cp, b);
 	  struct Lisp_Cons *s = p = cp -= offset % sizeof b->conses[0];
-	  if (!EQ (s->u.s.car, Vdead))
+	  if (!EQ (s->u.s.car, Vdead)
+	      && (CONS_MARKED_P (s) || !cons_block_unswept_p (b)))
 	    return make_lisp_ptr (s, Lisp_Cons);
 	}
     }
@@ -4563,12 +4900,15 @@ live_float_p (struct mem_node *m, void *p)
       ptrdiff_t offset = cp - (char *) &b->floats[0];
 
       /* P must point to the start of a Lisp_Float and not be
-	 one of the unused cells in the current float block.  */
+	 one of the unused cells in the current float block, nor
+	 a dead one in an unswept block.  */
       return (offset >= 0
 	      && offset % sizeof b->floats[0] == 0
 	      && offset < (FLOAT_BLOCK_SIZE * sizeof b->floats[0])
 	      && (b != float_block
-		  || offset / sizeof b->floats[0] < float_block_index));
+		  || offset / sizeof b->floats[0] < float_block_index)
+	      && (FLOAT_MARKED_P ((struct Lisp_Float *) p)
+		  || !float_block_unswept_p (b)));
     }
   else
     return 0;
@@ -5781,6 +6121,275 @@ mark_pinned_symbols (void)
     }
 }
 
+/* GC statistics.  Each collection records how long its phases took
+   and how many bytes of each kind of object it freed, in a ring
+   buffer that `garbage-collect-statistics' returns to Lisp.  If
+   `gc-statistics-log-file' names a file, every record is also
+   appended to it as one line of JSON.  */
+
+/* Number of collections whose statistics are kept.  */
+enum { GC_HISTORY_SIZE = 128 };
+
+/* The kinds of objects whose freed bytes are counted.  */
+enum gc_kind
+  {
+    GC_KIND_CONSES,
+    GC_KIND_FLOATS,
+    GC_KIND_SYMBOLS,
+    GC_KIND_MISCS,
+    GC_KIND_STRINGS,
+    GC_KIND_STRING_BYTES,
+    GC_KIND_VECTOR_SLOTS,
+    GC_KIND_INTERVALS,
+    GC_KINDS
+  };
+
+struct gc_record
+{
+  /* Value of gcs_done after this collection.  */
+  EMACS_INT number;
+
+  /* When the collection started, and how long it took in seconds.  */
+  struct timespec start;
+  double elapsed;
+
+  /* Seconds spent in each phase.  */
+  double phase[GC_PHASES];
+
+  /* Bytes freed, by kind of object.  */
+  EMACS_INT freed[GC_KINDS];
+
+  /* Bytes of whole blocks given back to malloc.  */
+  EMACS_INT released;
+
+  /* Whether the collection called malloc_trim.  */
+  bool trimmed;
+};
+
+static char const *const gc_phase_names[GC_PHASES] =
+  { "roots", "stack", "late-mark", "weak-tables", "sweep",
+    "compact-strings", "finalizers", "trim" };
+
+static char const *const gc_kind_names[GC_KINDS] =
+  { "conses", "floats", "symbols", "miscs", "strings", "string-bytes",
+    "vector-slots", "intervals" };
+
+static struct gc_record gc_history[GC_HISTORY_SIZE];
+
+/* The stream that statistics are logged to, and the value of
+   `gc-statistics-log-file' it was opened for.  */
+static FILE *gc_log_stream;
+static Lisp_Object gc_log_name;
+
+/* The record of the collection in progress, and when its current
+   phase started.  */
+static struct gc_record gc_current;
+static struct timespec gc_phase_start;
+
+/* Number of objects of each kind that were live after the previous
+   collection, and the corresponding allocation counters then.  */
+static EMACS_INT gc_live_after_last[GC_KINDS];
+static EMACS_INT gc_consed_after_last[GC_KINDS];
+
+/* Start timing a phase of the current collection.  */
+
+static void
+gc_phase_begin (void)
+{
+  gc_phase_start = current_timespec ();
+}
+
+/* Charge the time since the current phase started to PHASE, and
+   start timing the next one.  */
+
+static void
+gc_phase_end (enum gc_phase phase)
+{
+  struct timespec now = current_timespec ();
+  gc_current.phase[phase] += timespectod (timespec_sub (now, gc_phase_start));
+  gc_phase_start = now;
+}
+
+/* Store in COUNTS the number of objects of each kind allocated so
+   far, and in SIZES the size in bytes of each.  */
+
+static void
+gc_consed_counts (EMACS_INT counts[GC_KINDS], EMACS_INT sizes[GC_KINDS])
+{
+  /* Conses given back by free_cons were not freed by a collection.  */
+  counts[GC_KIND_CONSES] = cons_cells_consed - conses_freed_outside_gc;
+  sizes[GC_KIND_CONSES] = sizeof (struct Lisp_Cons);
+  counts[GC_KIND_FLOATS] = floats_consed;
+  sizes[GC_KIND_FLOATS] = sizeof (struct Lisp_Float);
+  counts[GC_KIND_SYMBOLS] = symbols_consed;
+  sizes[GC_KIND_SYMBOLS] = sizeof (struct Lisp_Symbol);
+  counts[GC_KIND_MISCS] = misc_objects_consed;
+  sizes[GC_KIND_MISCS] = sizeof (union Lisp_Misc);
+  counts[GC_KIND_STRINGS] = strings_consed;
+  sizes[GC_KIND_STRINGS] = sizeof (struct Lisp_String);
+  counts[GC_KIND_STRING_BYTES] = string_chars_consed;
+  sizes[GC_KIND_STRING_BYTES] = 1;
+  counts[GC_KIND_VECTOR_SLOTS] = vector_cells_consed;
+  sizes[GC_KIND_VECTOR_SLOTS] = word_size;
+  counts[GC_KIND_INTERVALS] = intervals_consed;
+  sizes[GC_KIND_INTERVALS] = sizeof (struct interval);
+}
+
+/* Store in COUNTS the number of objects of each kind found live by
+   the last sweep.  */
+
+static void
+gc_live_counts (EMACS_INT counts[GC_KINDS])
+{
+  counts[GC_KIND_CONSES] = total_conses;
+  counts[GC_KIND_FLOATS] = total_floats;
+  counts[GC_KIND_SYMBOLS] = total_symbols;
+  counts[GC_KIND_MISCS] = total_markers;
+  counts[GC_KIND_STRINGS] = total_strings;
+  counts[GC_KIND_STRING_BYTES] = total_string_bytes;
+  counts[GC_KIND_VECTOR_SLOTS] = total_vector_slots;
+  counts[GC_KIND_INTERVALS] = total_intervals;
+}
+
+/* Start the statistics of a collection starting at START.  */
+
+static void
+gc_record_begin (struct timespec start)
+{
+  memset (&gc_current, 0, sizeof gc_current);
+  gc_current.start = start;
+  gc_current.released = bytes_released;
+}
+
+/* Return the stream to log statistics to, or NULL if there is none.
+   The file is opened when `gc-statistics-log-file' is first seen with
+   a new value, and kept open until it changes again.  */
+
+static FILE *
+gc_log_file (void)
+{
+  if (!EQ (gc_log_name, Vgc_statistics_log_file))
+    {
+      if (gc_log_stream)
+	fclose (gc_log_stream);
+      gc_log_stream = NULL;
+      gc_log_name = Vgc_statistics_log_file;
+      if (STRINGP (gc_log_name))
+	{
+	  Lisp_Object file = ENCODE_FILE (Fexpand_file_name (gc_log_name,
+							     Qnil));
+	  gc_log_stream = emacs_fopen (SSDATA (file), "a" FOPEN_TEXT);
+	}
+    }
+  return gc_log_stream;
+}
+
+/* Finish the statistics of the current collection, store them in the
+   history, and log them if requested.  */
+
+static void
+gc_record_end (void)
+{
+  EMACS_INT consed[GC_KINDS], sizes[GC_KINDS], live[GC_KINDS];
+  int i;
+
+  gc_consed_counts (consed, sizes);
+  gc_live_counts (live);
+
+  /* What was live before this collection is what survived the last
+     one plus what has been allocated since.  */
+  for (i = 0; i < GC_KINDS; i++)
+    {
+      EMACS_INT before = (gc_live_after_last[i]
+			  + consed[i] - gc_consed_after_last[i]);
+      gc_current.freed[i] = max (0, before - live[i]) * sizes[i];
+      gc_live_after_last[i] = live[i];
+      gc_consed_after_last[i] = consed[i];
+    }
+
+  gc_current.number = gcs_done;
+  gc_current.released = bytes_released - gc_current.released;
+  gc_current.elapsed
+    = timespectod (timespec_sub (current_timespec (), gc_current.start));
+  gc_history[gcs_done % GC_HISTORY_SIZE] = gc_current;
+
+  FILE *f = gc_log_file ();
+  if (f)
+    {
+      fprintf (f, "{\"gc\":%"pI"d,\"start\":%.6f,\"elapsed\":%.6f",
+	       gc_current.number, timespectod (gc_current.start),
+	       gc_current.elapsed);
+      for (i = 0; i < GC_PHASES; i++)
+	fprintf (f, ",\"%s\":%.6f", gc_phase_names[i], gc_current.phase[i]);
+      fputs (",\"freed\":{", f);
+      for (i = 0; i < GC_KINDS; i++)
+	fprintf (f, "%s\"%s\":%"pI"d", i ? "," : "", gc_kind_names[i],
+		 gc_current.freed[i]);
+      fprintf (f, "},\"released\":%"pI"d,\"trimmed\":%s}\n",
+	       gc_current.released, gc_current.trimmed ? "true" : "false");
+      fflush (f);
+    }
+}
+
+DEFUN ("garbage-collect-statistics", Fgarbage_collect_statistics,
+       Sgarbage_collect_statistics, 0, 0, 0,
+       doc: /* Return statistics about recent garbage collections.
+The value is a list with one element for each of the most recent
+collections, newest first.  Each element is a property list with
+these properties:
+
+ `:gc'          the value of `gcs-done' after the collection,
+ `:start'       when the collection started, as a Lisp timestamp,
+ `:elapsed'     how long the collection took, in seconds,
+ `:phases'      an alist of (PHASE . SECONDS), one for each phase,
+ `:freed'       an alist of (KIND . BYTES), what the collection freed,
+ `:released'    how many bytes of freed blocks went back to malloc,
+ `:trimmed'     non-nil if the collection called `malloc-trim'.
+
+The phases are `roots' (marking from static roots, buffers and
+terminals), `stack' (scanning the stacks and specpdls of all threads),
+`late-mark' (font caches, undo lists and finalizers), `weak-tables',
+`sweep', `compact-strings', `finalizers' (running finalizers) and
+`trim' (giving memory back to the OS, see `gc-trim-threshold').
+The kinds of objects are those of `garbage-collect', with string
+headers and string data counted separately.
+
+At most 128 collections are remembered.  See also
+`gc-statistics-log-file'.  */)
+  (void)
+{
+  Lisp_Object result = Qnil;
+  EMACS_INT n;
+
+  for (n = max (1, gcs_done - GC_HISTORY_SIZE + 1); n <= gcs_done; n++)
+    {
+      struct gc_record *r = &gc_history[n % GC_HISTORY_SIZE];
+      Lisp_Object phases = Qnil, freed = Qnil;
+      int i;
+
+      if (r->number != n)
+	continue;
+      for (i = GC_PHASES - 1; 0 <= i; i--)
+	phases = Fcons (Fcons (intern_c_string (gc_phase_names[i]),
+			       make_float (r->phase[i])),
+			phases);
+      for (i = GC_KINDS - 1; 0 <= i; i--)
+	freed = Fcons (Fcons (intern_c_string (gc_kind_names[i]),
+			      make_number (r->freed[i])),
+		       freed);
+      result = Fcons (listn (CONSTYPE_HEAP, 14,
+			     QCgc, make_number (r->number),
+			     QCstart, make_lisp_time (r->start),
+			     QCelapsed, make_float (r->elapsed),
+			     QCphases, phases,
+			     QCfreed, freed,
+			     QCreleased, make_number (r->released),
+			     QCtrimmed, r->trimmed ? Qt : Qnil),
+		      result);
+    }
+  return result;
+}
+
 /* Subroutine of Fgarbage_collect that does most of the work.  It is a
    separate function so that we could limit mark_stack in searching
    the stack frames below this function, thus avoiding the rare cases
@@ -5871,10 +6480,23 @@ garbage_collect_1 (void *end)
 
   shrink_regexp_cache ();
 
+  gc_record_begin (start);
+
+  /* The blocks left unswept by the last collection are part of its
+     sweep, but the time is spent now.  */
+  gc_phase_begin ();
+  finish_lazy_sweep ();
+  gc_phase_end (GC_PHASE_SWEEP);
+
+  /* Let unreferenced floats in the cache die.  */
+  memset (float_cache, 0, sizeof float_cache);
+
   gc_in_progress = 1;
 
   /* Mark all the special slots that serve as the roots of accessibility.  */
 
+  gc_phase_begin ();
+
   mark_buffer (&buffer_defaults);
   mark_buffer (&buffer_local_symbols);
 
@@ -5888,7 +6510,7 @@ garbage_collect_1 (void *end)
   mark_pinned_symbols ();
   mark_terminals ();
   mark_kboards ();
-  mark_threads ();
+  mark_regexp_cache ();
 
 #ifdef USE_GTK
   xg_mark_data ();
@@ -5902,6 +6524,10 @@ garbage_collect_1 (void *end)
   mark_modules ();
 #endif
 
+  gc_phase_end (GC_PHASE_ROOTS);
+  mark_threads ();
+  gc_phase_end (GC_PHASE_STACK);
+
   /* Everything is now marked, except for the data in font caches,
      undo lists, and finalizers.  The first two are compacted by
      removing an items which aren't reachable otherwise.  */
@@ -5927,7 +6553,10 @@ garbage_collect_1 (void *end)
   queue_doomed_finalizers (&doomed_finalizers, &finalizers);
   mark_finalizer_list (&doomed_finalizers);
 
+  gc_phase_end (GC_PHASE_LATE_MARK);
+
   gc_sweep ();
+  shrink_mark_stack ();
 
   /* Clear the mark bits that we set in certain root slots.  */
   VECTOR_UNMARK (&buffer_defaults);
@@ -6007,7 +6636,21 @@ garbage_collect_1 (void *end)
   retval = CALLMANY (Flist, total);
 
   /* GC is complete: now we can run our finalizer callbacks.  */
+  gc_phase_begin ();
   run_finalizers (&doomed_finalizers);
+  gc_phase_end (GC_PHASE_FINALIZERS);
+
+  /* Give the memory of the blocks freed since the last trim back to
+     the OS, if there is enough of it.  Freed blocks are scattered
+     through the malloc heap, so without this the process never
+     shrinks after a burst of allocation.  */
+  if (INTEGERP (Vgc_trim_threshold)
+      && bytes_released - bytes_released_at_trim >= XINT (Vgc_trim_threshold))
+    {
+      trim_heap ();
+      gc_current.trimmed = true;
+      gc_phase_end (GC_PHASE_TRIM);
+    }
 
   if (!NILP (Vpost_gc_hook))
     {
@@ -6026,6 +6669,8 @@ garbage_collect_1 (void *end)
 
   gcs_done++;
 
+  gc_record_end ();
+
   /* Collect profiling data.  */
   if (profiler_memory_running)
     {
@@ -6102,56 +6747,186 @@ static int last_marked_index;
    Normally this is zero and the check never goes off.  */
 ptrdiff_t mark_object_loop_halt EXTERNALLY_VISIBLE;
 
-static void
-mark_vectorlike (struct Lisp_Vector *ptr)
+/* Objects that have been marked but whose contents still have to be
+   traversed are kept on an explicit stack rather than on the C
+   stack.  An entry is either a single Lisp_Object (N <= 0) or the
+   array of N > 0 Lisp_Objects starting at VALUES.  A single object
+   that is the cdr of a list is preceded by -N conses of that list,
+   for the sake of mark_object_loop_halt.  The stack is the unit of
+   pending marking work, so it is also what a future parallel marker
+   would split between threads.  */
+
+struct mark_entry
+{
+  ptrdiff_t n;
+  union {
+    Lisp_Object value;
+    Lisp_Object *values;
+  } u;
+};
+
+struct mark_stack
 {
-  ptrdiff_t size = ptr->header.size;
-  ptrdiff_t i;
+  struct mark_entry *stack;	/* base of stack */
+  ptrdiff_t size;		/* allocation size in entries */
+  ptrdiff_t sp;			/* current number of entries */
+};
 
-  eassert (!VECTOR_MARKED_P (ptr));
-  VECTOR_MARK (ptr);		/* Else mark it.  */
-  if (size & PSEUDOVECTOR_FLAG)
-    size &= PSEUDOVECTOR_SIZE_MASK;
+static struct mark_stack mark_stk;
 
-  /* Note that this size is not the memory-footprint size, but only
-     the number of Lisp_Object fields that we should trace.
-     The distinction is used e.g. by Lisp_Process which places extra
-     non-Lisp_Object fields at the end of the structure...  */
-  for (i = 0; i < size; i++) /* ...and then mark its elements.  */
-    mark_object (ptr->contents[i]);
-}
+/* Number of entries of mark stack space kept between collections.
+   One deep structure can make the stack much bigger than this; that
+   space is given back once the collection is over.  */
 
-/* Like mark_vectorlike but optimized for char-tables (and
-   sub-char-tables) assuming that the contents are mostly integers or
-   symbols.  */
+enum { MARK_STACK_KEEP = 4096 };
+
+/* Make room on the mark stack for one more entry.  */
 
 static void
-mark_char_table (struct Lisp_Vector *ptr, enum pvec_type pvectype)
+grow_mark_stack (void)
 {
-  int size = ptr->header.size & PSEUDOVECTOR_SIZE_MASK;
-  /* Consult the Lisp_Sub_Char_Table layout before changing this.  */
-  int i, idx = (pvectype == PVEC_SUB_CHAR_TABLE ? SUB_CHAR_TABLE_OFFSET : 0);
+  mark_stk.stack = xpalloc (mark_stk.stack, &mark_stk.size, 1, -1,
+			sizeof *mark_stk.stack);
+}
 
-  eassert (!VECTOR_MARKED_P (ptr));
-  VECTOR_MARK (ptr);
-  for (i = idx; i < size; i++)
-    {
-      Lisp_Object val = ptr->contents[i];
+/* Free the mark stack if it grew past MARK_STACK_KEEP entries.  It
+   must be empty.  */
 
-      if (INTEGERP (val) || (SYMBOLP (val) && XSYMBOL (val)->u.s.gcmarkbit))
-	continue;
-      if (SUB_CHAR_TABLE_P (val))
-	{
-	  if (! VECTOR_MARKED_P (XVECTOR (val)))
-	    mark_char_table (XVECTOR (val), PVEC_SUB_CHAR_TABLE);
-	}
-      else
-	mark_object (val);
+static void
+shrink_mark_stack (void)
+{
+  eassert (mark_stk.sp == 0);
+  if (mark_stk.size > MARK_STACK_KEEP)
+    {
+      xfree (mark_stk.stack);
+      mark_stk.stack = NULL;
+      mark_stk.size = 0;
     }
 }
 
-NO_INLINE /* To reduce stack depth in mark_object.  */
-static Lisp_Object
+/* Push the single object VALUE on the mark stack.  */
+
+static void
+mark_stack_push_value (Lisp_Object value)
+{
+  if (mark_stk.sp == mark_stk.size)
+    grow_mark_stack ();
+  mark_stk.stack[mark_stk.sp].n = 0;
+  mark_stk.stack[mark_stk.sp].u.value = value;
+  mark_stk.sp++;
+}
+
+/* Push VALUE, the cdr of a list whose first CDR_COUNT conses have
+   been marked, on the mark stack.  */
+
+static void
+mark_stack_push_cdr (Lisp_Object value, ptrdiff_t cdr_count)
+{
+  if (mark_stk.sp == mark_stk.size)
+    grow_mark_stack ();
+  mark_stk.stack[mark_stk.sp].n = -cdr_count;
+  mark_stk.stack[mark_stk.sp].u.value = value;
+  mark_stk.sp++;
+}
+
+/* Push the N objects starting at VALUES on the mark stack.  */
+
+static void
+mark_stack_push_values (Lisp_Object *values, ptrdiff_t n)
+{
+  if (n == 0)
+    return;
+  if (mark_stk.sp == mark_stk.size)
+    grow_mark_stack ();
+  mark_stk.stack[mark_stk.sp].n = n;
+  mark_stk.stack[mark_stk.sp].u.values = values;
+  mark_stk.sp++;
+}
+
+/* Pop and return the next object to mark, and store in *CDR_COUNT the
+   number of conses before it if it is the cdr of a list, zero
+   otherwise.  Arrays are consumed from left to right.  */
+
+static Lisp_Object
+mark_stack_pop (ptrdiff_t *cdr_count)
+{
+  struct mark_entry *e;
+
+  eassume (mark_stk.sp > 0);
+  e = &mark_stk.stack[mark_stk.sp - 1];
+  if (e->n <= 0)
+    {
+      mark_stk.sp--;
+      *cdr_count = -e->n;
+      return e->u.value;
+    }
+  *cdr_count = 0;
+  if (--e->n == 0)
+    mark_stk.sp--;
+  return *e->u.values++;
+}
+
+static void process_mark_stack (ptrdiff_t);
+
+/* Mark vector PTR and push its Lisp_Object fields on the mark stack.  */
+
+static void
+push_vectorlike_contents (struct Lisp_Vector *ptr)
+{
+  ptrdiff_t size = ptr->header.size;
+
+  eassert (!VECTOR_MARKED_P (ptr));
+  VECTOR_MARK (ptr);		/* Else mark it.  */
+  if (size & PSEUDOVECTOR_FLAG)
+    size &= PSEUDOVECTOR_SIZE_MASK;
+
+  /* Note that this size is not the memory-footprint size, but only
+     the number of Lisp_Object fields that we should trace.
+     The distinction is used e.g. by Lisp_Process which places extra
+     non-Lisp_Object fields at the end of the structure...  */
+  mark_stack_push_values (ptr->contents, size);
+}
+
+static void
+mark_vectorlike (struct Lisp_Vector *ptr)
+{
+  ptrdiff_t sp = mark_stk.sp;
+
+  push_vectorlike_contents (ptr);
+  process_mark_stack (sp);
+}
+
+/* Like mark_vectorlike but optimized for char-tables (and
+   sub-char-tables) assuming that the contents are mostly integers or
+   symbols.  */
+
+static void
+mark_char_table (struct Lisp_Vector *ptr, enum pvec_type pvectype)
+{
+  int size = ptr->header.size & PSEUDOVECTOR_SIZE_MASK;
+  /* Consult the Lisp_Sub_Char_Table layout before changing this.  */
+  int i, idx = (pvectype == PVEC_SUB_CHAR_TABLE ? SUB_CHAR_TABLE_OFFSET : 0);
+
+  eassert (!VECTOR_MARKED_P (ptr));
+  VECTOR_MARK (ptr);
+  for (i = idx; i < size; i++)
+    {
+      Lisp_Object val = ptr->contents[i];
+
+      if (INTEGERP (val) || (SYMBOLP (val) && XSYMBOL (val)->u.s.gcmarkbit))
+	continue;
+      if (SUB_CHAR_TABLE_P (val))
+	{
+	  if (! VECTOR_MARKED_P (XVECTOR (val)))
+	    mark_char_table (XVECTOR (val), PVEC_SUB_CHAR_TABLE);
+	}
+      else
+	mark_object (val);
+    }
+}
+
+NO_INLINE /* To reduce stack depth in mark_object.  */
+static Lisp_Object
 mark_compiled (struct Lisp_Vector *ptr)
 {
   int i, size = ptr->header.size & PSEUDOVECTOR_SIZE_MASK;
@@ -6298,21 +7073,21 @@ mark_discard_killed_buffers (Lisp_Object list)
 
 /* Determine type of generic Lisp_Object and mark it accordingly.
 
-   This function implements a straightforward depth-first marking
-   algorithm and so the recursion depth may be very high (a few
-   tens of thousands is not uncommon).  To minimize stack usage,
-   a few cold paths are moved out to NO_INLINE functions above.
-   In general, inlining them doesn't help you to gain more speed.  */
+   Conses, symbols and ordinary vectors push their contents on the
+   mark stack instead of recursing, so the depth of the C stack no
+   longer grows with the depth of the data.  A few cold paths still
+   call mark_object recursively; each such call drains only the
+   entries it pushed itself.  ARG is preceded by CDR_COUNT conses if
+   it is the cdr of a list.  */
 
-void
-mark_object (Lisp_Object arg)
+static void
+mark_one_object (Lisp_Object arg, ptrdiff_t cdr_count)
 {
   register Lisp_Object obj;
   void *po;
 #if GC_CHECK_MARKED_OBJECTS
   struct mem_node *m;
 #endif
-  ptrdiff_t cdr_count = 0;
 
   obj = arg;
  loop:
@@ -6515,7 +7290,7 @@ mark_object (Lisp_Object arg)
 	    emacs_abort ();
 
 	  default:
-	    mark_vectorlike (ptr);
+	    push_vectorlike_contents (ptr);
 	  }
       }
       break;
@@ -6530,16 +7305,18 @@ mark_object (Lisp_Object arg)
 	ptr->u.s.gcmarkbit = 1;
 	/* Attempt to catch bogus objects.  */
 	eassert (valid_lisp_object_p (ptr->u.s.function));
-	mark_object (ptr->u.s.function);
-	mark_object (ptr->u.s.plist);
+	mark_stack_push_value (ptr->u.s.function);
+	mark_stack_push_value (ptr->u.s.plist);
 	switch (ptr->u.s.redirect)
 	  {
-	  case SYMBOL_PLAINVAL: mark_object (SYMBOL_VAL (ptr)); break;
+	  case SYMBOL_PLAINVAL:
+	    mark_stack_push_value (SYMBOL_VAL (ptr));
+	    break;
 	  case SYMBOL_VARALIAS:
 	    {
 	      Lisp_Object tem;
 	      XSETSYMBOL (tem, SYMBOL_ALIAS (ptr));
-	      mark_object (tem);
+	      mark_stack_push_value (tem);
 	      break;
 	    }
 	  case SYMBOL_LOCALIZED:
@@ -6610,18 +7387,17 @@ mark_object (Lisp_Object arg)
 	  break;
 	CHECK_ALLOCATED_AND_LIVE (live_cons_p);
 	CONS_MARK (ptr);
-	/* If the cdr is nil, avoid recursion for the car.  */
-	if (EQ (ptr->u.s.u.cdr, Qnil))
+	/* Leave the cdr for later and go on with the car right away;
+	   for a proper list this keeps the mark stack one entry deep
+	   however long the list is.  */
+	if (!NILP (ptr->u.s.u.cdr))
 	  {
-	    obj = ptr->u.s.car;
-	    cdr_count = 0;
-	    goto loop;
+	    if (cdr_count + 1 == mark_object_loop_halt)
+	      emacs_abort ();
+	    mark_stack_push_cdr (ptr->u.s.u.cdr, cdr_count + 1);
 	  }
-	mark_object (ptr->u.s.car);
-	obj = ptr->u.s.u.cdr;
-	cdr_count++;
-	if (cdr_count == mark_object_loop_halt)
-	  emacs_abort ();
+	obj = ptr->u.s.car;
+	cdr_count = 0;
 	goto loop;
       }
 
@@ -6641,6 +7417,32 @@ mark_object (Lisp_Object arg)
 #undef CHECK_ALLOCATED
 #undef CHECK_ALLOCATED_AND_LIVE
 }
+
+/* Mark the objects on the mark stack above BASE_SP, and everything
+   reachable from them, leaving the stack pointer at BASE_SP.  */
+
+static void
+process_mark_stack (ptrdiff_t base_sp)
+{
+  while (mark_stk.sp > base_sp)
+    {
+      ptrdiff_t cdr_count;
+      Lisp_Object obj = mark_stack_pop (&cdr_count);
+      mark_one_object (obj, cdr_count);
+    }
+}
+
+/* Determine type of generic Lisp_Object and mark it, and everything
+   reachable from it, accordingly.  */
+
+void
+mark_object (Lisp_Object arg)
+{
+  ptrdiff_t sp = mark_stk.sp;
+
+  mark_stack_push_value (arg);
+  process_mark_stack (sp);
+}
 /* Mark the Lisp pointers in the terminal objects.
    Called by Fgarbage_collect.  */
 
@@ -6712,6 +7514,108 @@ survives_gc_p (Lisp_Object obj)
 
 
 
+/* Conses and floats are swept lazily.  At the end of a collection
+   only the current block of each kind, whose tail is not in use yet,
+   is swept.  The survivors in every other block are just counted from
+   its mark bits, and the block is left on the list of blocks that
+   still need sweeping.  Those are swept one at a time when the free
+   list runs dry, and whatever is left is swept at the start of the
+   next collection, before anything is marked.  This keeps the cost of
+   visiting every dead object out of the GC pause.  */
+
+/* Return the number of objects marked in the mark bits MARKBITS of a
+   block whose first LIM objects are in use.  */
+
+static int
+count_marked_objects (bits_word *markbits, int lim)
+{
+  int i, n = 0;
+  int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
+
+  for (i = 0; i < ilim; i++)
+    n += rust_count_one_bits (markbits[i]);
+  return n;
+}
+
+/* Put the unmarked ones among the first LIM conses of CBLK on the free
+   list and clear the mark bits of the others.  Return the number of
+   conses freed.  */
+
+static int
+sweep_cons_block (struct cons_block *cblk, int lim)
+{
+  int i;
+  int this_free = 0;
+  int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
+
+  /* Scan the mark bits an int at a time.  */
+  for (i = 0; i < ilim; i++)
+    {
+      int start, pos, stop;
+
+      if (cblk->gcmarkbits[i] == BITS_WORD_MAX)
+        {
+          /* Fast path - all cons cells for this int are marked.  */
+          cblk->gcmarkbits[i] = 0;
+          continue;
+        }
+
+      start = i * BITS_PER_BITS_WORD;
+      stop = lim - start;
+      if (stop > BITS_PER_BITS_WORD)
+        stop = BITS_PER_BITS_WORD;
+      stop += start;
+
+      if (cblk->gcmarkbits[i] == 0)
+        {
+          /* Fast path - no cons cell for this int survived.  This
+             is the common case for blocks full of short-lived
+             temporaries, so don't look at the mark bits one by
+             one.  */
+          for (pos = start; pos < stop; pos++)
+            {
+              cblk->conses[pos].u.s.u.chain = cons_free_list;
+              cons_free_list = &cblk->conses[pos];
+              cons_free_list->u.s.car = Vdead;
+            }
+          this_free += stop - start;
+        }
+      else
+        {
+          /* Some cons cells for this int are not marked.
+             Find which ones, and free them.  */
+          for (pos = start; pos < stop; pos++)
+            {
+              struct Lisp_Cons *acons
+                = ptr_bounds_copy (&cblk->conses[pos], cblk);
+              if (!CONS_MARKED_P (acons))
+                {
+                  this_free++;
+                  cblk->conses[pos].u.s.u.chain = cons_free_list;
+                  cons_free_list = &cblk->conses[pos];
+                  cons_free_list->u.s.car = Vdead;
+                }
+              else
+                CONS_UNMARK (acons);
+            }
+        }
+    }
+  return this_free;
+}
+
+/* Sweep the blocks left by the last GC until some cons is free.  */
+
+static void
+lazy_sweep_conses (void)
+{
+  while (!cons_free_list && cons_sweep_cursor)
+    {
+      struct cons_block *cblk = cons_sweep_cursor;
+      cons_sweep_cursor = cblk->next;
+      sweep_cons_block (cblk, CONS_BLOCK_SIZE);
+    }
+}
+
 NO_INLINE /* For better stack traces */
 static void
 sweep_conses (void)
@@ -6721,127 +7625,164 @@ sweep_conses (void)
   int lim = cons_block_index;
   EMACS_INT num_free = 0, num_used = 0;
 
+  eassert (!cons_sweep_cursor);
   cons_free_list = 0;
 
   for (cblk = cons_block; cblk; cblk = *cprev)
     {
-      int i = 0;
-      int this_free = 0;
-      int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
-
-      /* Scan the mark bits an int at a time.  */
-      for (i = 0; i < ilim; i++)
-        {
-          if (cblk->gcmarkbits[i] == BITS_WORD_MAX)
-            {
-              /* Fast path - all cons cells for this int are marked.  */
-              cblk->gcmarkbits[i] = 0;
-              num_used += BITS_PER_BITS_WORD;
-            }
-          else
-            {
-              /* Some cons cells for this int are not marked.
-                 Find which ones, and free them.  */
-              int start, pos, stop;
+      int this_free;
 
-              start = i * BITS_PER_BITS_WORD;
-              stop = lim - start;
-              if (stop > BITS_PER_BITS_WORD)
-                stop = BITS_PER_BITS_WORD;
-              stop += start;
-
-              for (pos = start; pos < stop; pos++)
-                {
-		  struct Lisp_Cons *acons
-		    = ptr_bounds_copy (&cblk->conses[pos], cblk);
-		  if (!CONS_MARKED_P (acons))
-                    {
-                      this_free++;
-                      cblk->conses[pos].u.s.u.chain = cons_free_list;
-                      cons_free_list = &cblk->conses[pos];
-                      cons_free_list->u.s.car = Vdead;
-                    }
-                  else
-                    {
-                      num_used++;
-		      CONS_UNMARK (acons);
-                    }
-                }
-            }
-        }
+      /* Sweep the current block now, since its unused tail must not
+         end up on the free list; leave the others for later.  */
+      if (cblk == cons_block)
+        this_free = sweep_cons_block (cblk, lim);
+      else
+        this_free = lim - count_marked_objects (cblk->gcmarkbits, lim);
 
-      lim = CONS_BLOCK_SIZE;
       /* If this block contains only free conses and we have already
          seen more than two blocks worth of free conses then deallocate
-         this block.  */
+         this block.  Such a block is never the current one, so none
+         of its conses are on the free list.  */
       if (this_free == CONS_BLOCK_SIZE && num_free > CONS_BLOCK_SIZE)
         {
           *cprev = cblk->next;
-          /* Unhook from the free list.  */
-          cons_free_list = cblk->conses[0].u.s.u.chain;
           lisp_align_free (cblk);
         }
       else
         {
           num_free += this_free;
+          num_used += lim - this_free;
           cprev = &cblk->next;
         }
+      lim = CONS_BLOCK_SIZE;
     }
+  cons_sweep_cursor = cons_block ? cons_block->next : NULL;
   total_conses = num_used;
   total_free_conses = num_free;
 }
 
+/* Like sweep_cons_block, for the first LIM floats of FBLK.  */
+
+static int
+sweep_float_block (struct float_block *fblk, int lim)
+{
+  int i;
+  int this_free = 0;
+  int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
+
+  /* Scan the mark bits an int at a time, like sweep_cons_block.  */
+  for (i = 0; i < ilim; i++)
+    {
+      bits_word marks = fblk->gcmarkbits[i];
+      int start, pos, stop;
+
+      if (marks == BITS_WORD_MAX)
+        {
+          /* Fast path - all floats for this int are marked.  */
+          fblk->gcmarkbits[i] = 0;
+          continue;
+        }
+
+      start = i * BITS_PER_BITS_WORD;
+      stop = lim - start;
+      if (stop > BITS_PER_BITS_WORD)
+        stop = BITS_PER_BITS_WORD;
+      stop += start;
+
+      if (marks == 0)
+        {
+          /* Fast path - none of these floats survived.  */
+          for (pos = start; pos < stop; pos++)
+            {
+              fblk->floats[pos].u.chain = float_free_list;
+              float_free_list = &fblk->floats[pos];
+            }
+          this_free += stop - start;
+          continue;
+        }
+
+      for (pos = start; pos < stop; pos++)
+        if (! (marks & ((bits_word) 1 << (pos - start))))
+          {
+            this_free++;
+            fblk->floats[pos].u.chain = float_free_list;
+            float_free_list = &fblk->floats[pos];
+          }
+      fblk->gcmarkbits[i] = 0;
+    }
+  return this_free;
+}
+
+/* Sweep the blocks left by the last GC until some float is free.  */
+
+static void
+lazy_sweep_floats (void)
+{
+  while (!float_free_list && float_sweep_cursor)
+    {
+      struct float_block *fblk = float_sweep_cursor;
+      float_sweep_cursor = fblk->next;
+      sweep_float_block (fblk, FLOAT_BLOCK_SIZE);
+    }
+}
+
 NO_INLINE /* For better stack traces */
 static void
 sweep_floats (void)
 {
-  register struct float_block *fblk;
+  struct float_block *fblk;
   struct float_block **fprev = &float_block;
-  register int lim = float_block_index;
+  int lim = float_block_index;
   EMACS_INT num_free = 0, num_used = 0;
 
+  eassert (!float_sweep_cursor);
   float_free_list = 0;
 
   for (fblk = float_block; fblk; fblk = *fprev)
     {
-      register int i;
-      int this_free = 0;
-      for (i = 0; i < lim; i++)
-	{
-	  struct Lisp_Float *afloat = ptr_bounds_copy (&fblk->floats[i], fblk);
-	  if (!FLOAT_MARKED_P (afloat))
-	    {
-	      this_free++;
-	      fblk->floats[i].u.chain = float_free_list;
-	      float_free_list = &fblk->floats[i];
-	    }
-	  else
-	    {
-	      num_used++;
-	      FLOAT_UNMARK (afloat);
-	    }
-	}
-      lim = FLOAT_BLOCK_SIZE;
+      int this_free;
+
+      /* As in sweep_conses, only the current block is swept now.  */
+      if (fblk == float_block)
+        this_free = sweep_float_block (fblk, lim);
+      else
+        this_free = lim - count_marked_objects (fblk->gcmarkbits, lim);
+
       /* If this block contains only free floats and we have already
          seen more than two blocks worth of free floats then deallocate
          this block.  */
       if (this_free == FLOAT_BLOCK_SIZE && num_free > FLOAT_BLOCK_SIZE)
         {
           *fprev = fblk->next;
-          /* Unhook from the free list.  */
-          float_free_list = fblk->floats[0].u.chain;
           lisp_align_free (fblk);
         }
       else
         {
           num_free += this_free;
+          num_used += lim - this_free;
           fprev = &fblk->next;
         }
+      lim = FLOAT_BLOCK_SIZE;
     }
+  float_sweep_cursor = float_block ? float_block->next : NULL;
   total_floats = num_used;
   total_free_floats = num_free;
 }
 
+/* Sweep everything the last GC left for lazy sweeping.  This must be
+   done before marking starts: the dead objects in unswept blocks still
+   look live to the conservative stack scan, and they may point to
+   objects that have been freed since.  */
+
+static void
+finish_lazy_sweep (void)
+{
+  for (; cons_sweep_cursor; cons_sweep_cursor = cons_sweep_cursor->next)
+    sweep_cons_block (cons_sweep_cursor, CONS_BLOCK_SIZE);
+  for (; float_sweep_cursor; float_sweep_cursor = float_sweep_cursor->next)
+    sweep_float_block (float_sweep_cursor, FLOAT_BLOCK_SIZE);
+}
+
 NO_INLINE /* For better stack traces */
 static void
 sweep_intervals (void)
@@ -6881,6 +7822,7 @@ sweep_intervals (void)
           *iprev = iblk->next;
           /* Unhook from the free list.  */
           interval_free_list = INTERVAL_PARENT (&iblk->intervals[0]);
+          bytes_released += sizeof *iblk;
           lisp_free (iblk);
         }
       else
@@ -7063,6 +8005,7 @@ gc_sweep (void)
   /* Remove or mark entries in weak hash tables.
      This must be done before any object is unmarked.  */
   sweep_weak_hash_tables ();
+  gc_phase_end (GC_PHASE_WEAK_TABLES);
 
   sweep_strings ();
   check_string_bytes (!noninteractive);
@@ -7074,6 +8017,37 @@ gc_sweep (void)
   sweep_buffers ();
   sweep_vectors ();
   check_string_bytes (!noninteractive);
+  gc_phase_end (GC_PHASE_SWEEP);
+}
+
+/* Give free memory at the top of the malloc heap, and whole free
+   pages inside it, back to the OS.  Return true if any was.  */
+
+static bool
+trim_heap (void)
+{
+  bytes_released_at_trim = bytes_released;
+#ifdef USE_MALLOC_TRIM
+  return malloc_trim (0);
+#else
+  return false;
+#endif
+}
+
+DEFUN ("malloc-trim", Fmalloc_trim, Smalloc_trim, 0, 0, "",
+       doc: /* Give memory that Emacs no longer uses back to the OS.
+Garbage collection puts the blocks that held dead Lisp objects back
+into the C library's heap, where they are reused for new objects but
+still count towards the size of the process.  This function asks the
+C library to hand the free parts of its heap back to the OS.  It is
+called automatically after a garbage collection that freed at least
+`gc-trim-threshold' bytes of blocks.
+
+Value is non-nil if any memory was given back.  This does nothing on
+systems whose C library cannot do it.  */)
+  (void)
+{
+  return trim_heap () ? Qt : Qnil;
 }
 
 DEFUN ("memory-info", Fmemory_info, Smemory_info, 0, 0, 0,
@@ -7198,6 +8172,587 @@ which_symbols (Lisp_Object obj, EMACS_INT find_max)
    return found;
 }
 
+/* Heap snapshots.
+
+   `dump-heap-snapshot' writes the graph of Lisp objects reachable from
+   the GC roots to a file, for analysis by lib-src/heap-analyze.  The
+   walk does not use the mark bits and does not allocate Lisp objects,
+   so it can run at any time outside of GC.  It follows the same edges
+   as mark_one_object, except that weak hash tables do not refer to
+   their contents and the C stacks are not scanned.
+
+   The file starts with HEAP_SNAPSHOT_MAGIC and a table of type names,
+   followed by records.  All integers are unsigned and little-endian.
+
+     u8 NTYPES, then NTYPES times: u8 LEN, LEN bytes of type name
+     'R' u8 ROOT-KIND u64 ADDRESS
+     'O' u64 ADDRESS u8 TYPE u64 SIZE u32 NREFS NREFS*u64
+         u16 LEN LEN bytes of label (the name of a symbol, else empty)
+     'E' end of snapshot
+
+   SIZE counts the object itself and the memory that it owns: string
+   data, buffer text, intervals and the key/value vector of a weak hash
+   table.  */
+
+#define HEAP_SNAPSHOT_MAGIC "EHEAPSN1"
+
+enum heap_snapshot_root
+  {
+    HEAP_ROOT_STATICPRO,
+    HEAP_ROOT_SYMBOL,
+    HEAP_ROOT_BUFFER,
+    HEAP_ROOT_THREAD,
+    HEAP_ROOT_PINNED,
+    HEAP_ROOT_TERMINAL,
+    HEAP_ROOT_KBOARD,
+    HEAP_ROOT_REGEXP_CACHE
+  };
+
+enum heap_snapshot_type
+  {
+    HEAP_TYPE_CONS,
+    HEAP_TYPE_FLOAT,
+    HEAP_TYPE_STRING,
+    HEAP_TYPE_SYMBOL,
+    HEAP_TYPE_MARKER,
+    HEAP_TYPE_OVERLAY,
+    HEAP_TYPE_SAVE_VALUE,
+    HEAP_TYPE_FINALIZER,
+    HEAP_TYPE_USER_PTR,
+    /* Vector-like objects use HEAP_TYPE_VECTORLIKE + their pvec_type.  */
+    HEAP_TYPE_VECTORLIKE
+  };
+
+static char const *const heap_snapshot_type_names[] =
+  {
+    [HEAP_TYPE_CONS] = "cons",
+    [HEAP_TYPE_FLOAT] = "float",
+    [HEAP_TYPE_STRING] = "string",
+    [HEAP_TYPE_SYMBOL] = "symbol",
+    [HEAP_TYPE_MARKER] = "marker",
+    [HEAP_TYPE_OVERLAY] = "overlay",
+    [HEAP_TYPE_SAVE_VALUE] = "save-value",
+    [HEAP_TYPE_FINALIZER] = "finalizer",
+    [HEAP_TYPE_USER_PTR] = "user-ptr",
+    [HEAP_TYPE_VECTORLIKE + PVEC_NORMAL_VECTOR] = "vector",
+    [HEAP_TYPE_VECTORLIKE + PVEC_FREE] = "free",
+    [HEAP_TYPE_VECTORLIKE + PVEC_PROCESS] = "process",
+    [HEAP_TYPE_VECTORLIKE + PVEC_FRAME] = "frame",
+    [HEAP_TYPE_VECTORLIKE + PVEC_WINDOW] = "window",
+    [HEAP_TYPE_VECTORLIKE + PVEC_BOOL_VECTOR] = "bool-vector",
+    [HEAP_TYPE_VECTORLIKE + PVEC_BUFFER] = "buffer",
+    [HEAP_TYPE_VECTORLIKE + PVEC_HASH_TABLE] = "hash-table",
+    [HEAP_TYPE_VECTORLIKE + PVEC_TERMINAL] = "terminal",
+    [HEAP_TYPE_VECTORLIKE + PVEC_WINDOW_CONFIGURATION]
+      = "window-configuration",
+    [HEAP_TYPE_VECTORLIKE + PVEC_SUBR] = "subr",
+    [HEAP_TYPE_VECTORLIKE + PVEC_OTHER] = "other",
+    [HEAP_TYPE_VECTORLIKE + PVEC_XWIDGET] = "xwidget",
+    [HEAP_TYPE_VECTORLIKE + PVEC_XWIDGET_VIEW] = "xwidget-view",
+    [HEAP_TYPE_VECTORLIKE + PVEC_THREAD] = "thread",
+    [HEAP_TYPE_VECTORLIKE + PVEC_MUTEX] = "mutex",
+    [HEAP_TYPE_VECTORLIKE + PVEC_CONDVAR] = "condition-variable",
+    [HEAP_TYPE_VECTORLIKE + PVEC_MODULE_FUNCTION] = "module-function",
+    [HEAP_TYPE_VECTORLIKE + PVEC_BUFFER_SNAPSHOT] = "buffer-snapshot",
+    [HEAP_TYPE_VECTORLIKE + PVEC_COMPILED] = "compiled-function",
+    [HEAP_TYPE_VECTORLIKE + PVEC_CHAR_TABLE] = "char-table",
+    [HEAP_TYPE_VECTORLIKE + PVEC_SUB_CHAR_TABLE] = "sub-char-table",
+    [HEAP_TYPE_VECTORLIKE + PVEC_RECORD] = "record",
+    [HEAP_TYPE_VECTORLIKE + PVEC_FONT] = "font"
+  };
+
+struct heap_snapshot
+{
+  FILE *stream;
+
+  /* Addresses of the objects seen so far, in an open-addressing hash
+     table whose size is a power of two.  Zero marks an empty slot.  */
+  uintptr_t *seen;
+  ptrdiff_t seen_size, seen_count;
+
+  /* Objects seen but not yet written.  */
+  Lisp_Object *work;
+  ptrdiff_t work_size, work_count;
+
+  /* The references of the object being written.  */
+  Lisp_Object *refs;
+  ptrdiff_t refs_size, refs_count;
+
+  /* Bytes owned by the object being written.  */
+  uintmax_t size;
+};
+
+static void
+heap_snapshot_put (struct heap_snapshot *hs, uintmax_t n, int bytes)
+{
+  for (; 0 < bytes; bytes--, n >>= CHAR_BIT)
+    putc (n & UCHAR_MAX, hs->stream);
+}
+
+static uintptr_t
+heap_snapshot_address (Lisp_Object obj)
+{
+  return (uintptr_t) XPNTR (obj);
+}
+
+/* Return true if OBJ should not appear in the snapshot: it is not a
+   heap object, or it is shared by so many objects that recording
+   references to it would only add noise.  */
+
+static bool
+heap_snapshot_ignored_p (Lisp_Object obj)
+{
+  return (INTEGERP (obj) || NILP (obj) || SUBRP (obj)
+	  || PURE_P (XPNTR (obj)));
+}
+
+/* Return true if OBJ had not been seen before, and remember it.  */
+
+static bool
+heap_snapshot_note (struct heap_snapshot *hs, Lisp_Object obj)
+{
+  uintptr_t addr = heap_snapshot_address (obj);
+  ptrdiff_t mask, i;
+
+  if (hs->seen_size <= 2 * hs->seen_count)
+    {
+      uintptr_t *old = hs->seen;
+      ptrdiff_t old_size = hs->seen_size;
+      hs->seen_size = old_size ? 2 * old_size : 1 << 12;
+      hs->seen = xzalloc (hs->seen_size * sizeof *hs->seen);
+      mask = hs->seen_size - 1;
+      for (ptrdiff_t j = 0; j < old_size; j++)
+	if (old[j])
+	  {
+	    for (i = old[j] / GCALIGNMENT & mask; hs->seen[i];
+		 i = (i + 1) & mask)
+	      continue;
+	    hs->seen[i] = old[j];
+	  }
+      xfree (old);
+    }
+
+  mask = hs->seen_size - 1;
+  for (i = addr / GCALIGNMENT & mask; hs->seen[i]; i = (i + 1) & mask)
+    if (hs->seen[i] == addr)
+      return false;
+  hs->seen[i] = addr;
+  hs->seen_count++;
+  return true;
+}
+
+/* Queue OBJ for writing unless it has been seen already.  */
+
+static void
+heap_snapshot_visit (struct heap_snapshot *hs, Lisp_Object obj)
+{
+  if (heap_snapshot_note (hs, obj))
+    {
+      if (hs->work_count == hs->work_size)
+	hs->work = xpalloc (hs->work, &hs->work_size, 1, -1,
+			    sizeof *hs->work);
+      hs->work[hs->work_count++] = obj;
+    }
+}
+
+static void
+heap_snapshot_root (struct heap_snapshot *hs, enum heap_snapshot_root kind,
+		    Lisp_Object obj)
+{
+  if (heap_snapshot_ignored_p (obj))
+    return;
+  putc ('R', hs->stream);
+  heap_snapshot_put (hs, kind, 1);
+  heap_snapshot_put (hs, heap_snapshot_address (obj), 8);
+  heap_snapshot_visit (hs, obj);
+}
+
+static void
+heap_snapshot_thread_root (Lisp_Object obj, void *hs)
+{
+  heap_snapshot_root (hs, HEAP_ROOT_THREAD, obj);
+}
+
+static void
+heap_snapshot_kboard_root (Lisp_Object obj, void *hs)
+{
+  heap_snapshot_root (hs, HEAP_ROOT_KBOARD, obj);
+}
+
+static void
+heap_snapshot_regexp_cache_root (Lisp_Object obj, void *hs)
+{
+  heap_snapshot_root (hs, HEAP_ROOT_REGEXP_CACHE, obj);
+}
+
+static void
+heap_snapshot_ref (struct heap_snapshot *hs, Lisp_Object obj)
+{
+  if (heap_snapshot_ignored_p (obj))
+    return;
+  if (hs->refs_count == hs->refs_size)
+    hs->refs = xpalloc (hs->refs, &hs->refs_size, 1, -1, sizeof *hs->refs);
+  hs->refs[hs->refs_count++] = obj;
+}
+
+static void
+heap_snapshot_refs (struct heap_snapshot *hs, Lisp_Object *v, ptrdiff_t n)
+{
+  for (ptrdiff_t i = 0; i < n; i++)
+    heap_snapshot_ref (hs, v[i]);
+}
+
+static void
+heap_snapshot_interval (INTERVAL i, void *hs)
+{
+  heap_snapshot_ref (hs, i->plist);
+  ((struct heap_snapshot *) hs)->size += sizeof *i;
+}
+
+static void
+heap_snapshot_overlays (struct heap_snapshot *hs, struct Lisp_Overlay *ov)
+{
+  for (; ov; ov = ov->next)
+    {
+      Lisp_Object tem;
+      XSETMISC (tem, ov);
+      heap_snapshot_ref (hs, tem);
+    }
+}
+
+/* Collect the size and references of the vector-like object PTR, and
+   return its snapshot type.  */
+
+static int
+heap_snapshot_vectorlike (struct heap_snapshot *hs, struct Lisp_Vector *ptr)
+{
+  enum pvec_type pvectype = PSEUDOVECTOR_TYPE (ptr);
+  ptrdiff_t size = ptr->header.size;
+  ptrdiff_t start = 0;
+
+  if (size & PSEUDOVECTOR_FLAG)
+    size &= PSEUDOVECTOR_SIZE_MASK;
+  hs->size = vector_nbytes (ptr);
+
+  switch (pvectype)
+    {
+    case PVEC_BOOL_VECTOR:
+      size = 0;
+      break;
+
+    case PVEC_SUB_CHAR_TABLE:
+      start = SUB_CHAR_TABLE_OFFSET;
+      break;
+
+    case PVEC_BUFFER:
+      {
+	struct buffer *b = (struct buffer *) ptr;
+
+	if (b->text == &b->own_text && b->own_text.beg)
+	  hs->size += BUF_Z_BYTE (b) - BUF_BEG_BYTE (b) + BUF_GAP_SIZE (b) + 1;
+	traverse_intervals_noorder (buffer_intervals (b),
+				    heap_snapshot_interval, hs);
+	heap_snapshot_overlays (hs, b->overlays_before);
+	heap_snapshot_overlays (hs, b->overlays_after);
+	/* The undo list is not among the slots walked below; GC marks
+	   it separately, after compacting it.  */
+	heap_snapshot_ref (hs, BVAR (b, undo_list));
+	if (b->base_buffer)
+	  {
+	    Lisp_Object tem;
+	    XSETBUFFER (tem, b->base_buffer);
+	    heap_snapshot_ref (hs, tem);
+	  }
+      }
+      break;
+
+    case PVEC_BUFFER_SNAPSHOT:
+      {
+	struct Lisp_Buffer_Snapshot *s = (struct Lisp_Buffer_Snapshot *) ptr;
+	hs->size += s->nbytes + 1 + s->nindex * sizeof *s->index;
+      }
+      break;
+
+    case PVEC_HASH_TABLE:
+      {
+	struct Lisp_Hash_Table *h = (struct Lisp_Hash_Table *) ptr;
+
+	heap_snapshot_ref (hs, h->test.name);
+	heap_snapshot_ref (hs, h->test.user_hash_function);
+	heap_snapshot_ref (hs, h->test.user_cmp_function);
+	/* The entries of a weak table do not keep anything alive, so
+	   charge its key/value vector to the table itself.  */
+	if (NILP (h->weak))
+	  heap_snapshot_ref (hs, h->key_and_value);
+	else
+	  hs->size += vector_nbytes (XVECTOR (h->key_and_value));
+      }
+      break;
+
+    default:
+      break;
+    }
+
+  heap_snapshot_refs (hs, ptr->contents + start, size - start);
+  return HEAP_TYPE_VECTORLIKE + pvectype;
+}
+
+/* Write the record of OBJ, and queue the objects it refers to.  */
+
+static void
+heap_snapshot_object (struct heap_snapshot *hs, Lisp_Object obj)
+{
+  struct Lisp_String *label = NULL;
+  int type;
+
+  hs->refs_count = 0;
+  hs->size = 0;
+
+  switch (XTYPE (obj))
+    {
+    case Lisp_String:
+      {
+	struct Lisp_String *ptr = XSTRING (obj);
+	type = HEAP_TYPE_STRING;
+	hs->size = sizeof *ptr + (ptr->u.s.data ? STRING_BYTES (ptr) + 1 : 0);
+	traverse_intervals_noorder (ptr->u.s.intervals,
+				    heap_snapshot_interval, hs);
+      }
+      break;
+
+    case Lisp_Vectorlike:
+      type = heap_snapshot_vectorlike (hs, XVECTOR (obj));
+      break;
+
+    case Lisp_Symbol:
+      {
+	struct Lisp_Symbol *ptr = XSYMBOL (obj);
+	type = HEAP_TYPE_SYMBOL;
+	hs->size = sizeof *ptr;
+	heap_snapshot_ref (hs, ptr->u.s.function);
+	heap_snapshot_ref (hs, ptr->u.s.plist);
+	switch (ptr->u.s.redirect)
+	  {
+	  case SYMBOL_PLAINVAL:
+	    heap_snapshot_ref (hs, SYMBOL_VAL (ptr));
+	    break;
+	  case SYMBOL_VARALIAS:
+	    {
+	      Lisp_Object tem;
+	      XSETSYMBOL (tem, SYMBOL_ALIAS (ptr));
+	      heap_snapshot_ref (hs, tem);
+	      break;
+	    }
+	  case SYMBOL_LOCALIZED:
+	    {
+	      struct Lisp_Buffer_Local_Value *blv = SYMBOL_BLV (ptr);
+	      hs->size += sizeof *blv;
+	      heap_snapshot_ref (hs, blv->where);
+	      heap_snapshot_ref (hs, blv->valcell);
+	      heap_snapshot_ref (hs, blv->defcell);
+	      break;
+	    }
+	  case SYMBOL_FORWARDED:
+	    break;
+	  default: emacs_abort ();
+	  }
+	heap_snapshot_ref (hs, ptr->u.s.name);
+	if (ptr->u.s.next)
+	  heap_snapshot_ref (hs, make_lisp_symbol (ptr->u.s.next));
+	if (STRINGP (ptr->u.s.name))
+	  label = XSTRING (ptr->u.s.name);
+      }
+      break;
+
+    case Lisp_Misc:
+      hs->size = sizeof (union Lisp_Misc);
+      switch (XMISCTYPE (obj))
+	{
+	case Lisp_Misc_Marker:
+	  type = HEAP_TYPE_MARKER;
+	  break;
+
+	case Lisp_Misc_Save_Value:
+	  {
+	    struct Lisp_Save_Value *ptr = XSAVE_VALUE (obj);
+	    type = HEAP_TYPE_SAVE_VALUE;
+	    /* A SAVE_TYPE_MEMORY area holds only conservative roots.  */
+	    if (ptr->save_type != SAVE_TYPE_MEMORY)
+	      for (int i = 0; i < SAVE_VALUE_SLOTS; i++)
+		if (save_type (ptr, i) == SAVE_OBJECT)
+		  heap_snapshot_ref (hs, ptr->data[i].object);
+	  }
+	  break;
+
+	case Lisp_Misc_Overlay:
+	  {
+	    struct Lisp_Overlay *ptr = XOVERLAY (obj);
+	    type = HEAP_TYPE_OVERLAY;
+	    heap_snapshot_ref (hs, ptr->start);
+	    heap_snapshot_ref (hs, ptr->end);
+	    heap_snapshot_ref (hs, ptr->plist);
+	  }
+	  break;
+
+	case Lisp_Misc_Finalizer:
+	  type = HEAP_TYPE_FINALIZER;
+	  heap_snapshot_ref (hs, XFINALIZER (obj)->function);
+	  break;
+
+#ifdef HAVE_MODULES
+	case Lisp_Misc_User_Ptr:
+	  type = HEAP_TYPE_USER_PTR;
+	  break;
+#endif
+
+	default:
+	  emacs_abort ();
+	}
+      break;
+
+    case Lisp_Cons:
+      type = HEAP_TYPE_CONS;
+      hs->size = sizeof (struct Lisp_Cons);
+      heap_snapshot_ref (hs, XCAR (obj));
+      heap_snapshot_ref (hs, XCDR (obj));
+      break;
+
+    case Lisp_Float:
+      type = HEAP_TYPE_FLOAT;
+      hs->size = sizeof (struct Lisp_Float);
+      break;
+
+    default:
+      emacs_abort ();
+    }
+
+  putc ('O', hs->stream);
+  heap_snapshot_put (hs, heap_snapshot_address (obj), 8);
+  heap_snapshot_put (hs, type, 1);
+  heap_snapshot_put (hs, hs->size, 8);
+  heap_snapshot_put (hs, hs->refs_count, 4);
+  for (ptrdiff_t i = 0; i < hs->refs_count; i++)
+    {
+      heap_snapshot_put (hs, heap_snapshot_address (hs->refs[i]), 8);
+      heap_snapshot_visit (hs, hs->refs[i]);
+    }
+  if (label)
+    {
+      ptrdiff_t nbytes = min (STRING_BYTES (label), USHRT_MAX);
+      heap_snapshot_put (hs, nbytes, 2);
+      fwrite (label->u.s.data, 1, nbytes, hs->stream);
+    }
+  else
+    heap_snapshot_put (hs, 0, 2);
+}
+
+static void
+heap_snapshot_free (void *arg)
+{
+  struct heap_snapshot *hs = arg;
+  if (hs->stream)
+    fclose (hs->stream);
+  xfree (hs->seen);
+  xfree (hs->work);
+  xfree (hs->refs);
+}
+
+DEFUN ("dump-heap-snapshot", Fdump_heap_snapshot, Sdump_heap_snapshot,
+       1, 1, "FDump heap snapshot to file: ",
+       doc: /* Write the graph of live Lisp objects to FILE.
+The snapshot records, for each object reachable from the garbage
+collector's roots, its address, type, size in bytes and the objects it
+refers to, plus the roots themselves.  Objects that are only referenced
+from the C stack are not included.
+
+The file is meant to be read by the `heap-analyze' program, which
+computes the retained size of each object and reports which objects
+keep the most memory alive.  Value is the number of objects written.  */)
+  (Lisp_Object file)
+{
+  struct heap_snapshot hs = { NULL, };
+  ptrdiff_t count = SPECPDL_INDEX ();
+  ptrdiff_t i, nobjects = 0;
+  struct buffer *b;
+  Lisp_Object encoded;
+
+  CHECK_STRING (file);
+  file = Fexpand_file_name (file, Qnil);
+  encoded = ENCODE_FILE (file);
+
+  record_unwind_protect_ptr (heap_snapshot_free, &hs);
+  hs.stream = emacs_fopen (SSDATA (encoded), "wb");
+  if (!hs.stream)
+    report_file_error ("Opening heap snapshot", file);
+
+  fputs (HEAP_SNAPSHOT_MAGIC, hs.stream);
+  heap_snapshot_put (&hs, ARRAYELTS (heap_snapshot_type_names), 1);
+  for (i = 0; i < ARRAYELTS (heap_snapshot_type_names); i++)
+    {
+      char const *name = heap_snapshot_type_names[i];
+      int len = name ? strlen (name) : 0;
+      heap_snapshot_put (&hs, len, 1);
+      if (len)
+	fwrite (name, 1, len, hs.stream);
+    }
+
+  /* The roots, in the order garbage_collect_1 marks them, except
+     that the fringe faces and the GTK menu and tool bar data of
+     window-system frames are left out.  Then the live buffers: they
+     are reachable from `buffer-list' anyway, but recording them as
+     roots makes each buffer's retained size meaningful.  */
+  Lisp_Object tem;
+  XSETBUFFER (tem, &buffer_defaults);
+  heap_snapshot_root (&hs, HEAP_ROOT_BUFFER, tem);
+  XSETBUFFER (tem, &buffer_local_symbols);
+  heap_snapshot_root (&hs, HEAP_ROOT_BUFFER, tem);
+  for (i = 0; i < ARRAYELTS (lispsym); i++)
+    heap_snapshot_root (&hs, HEAP_ROOT_SYMBOL, builtin_lisp_symbol (i));
+  for (i = 0; i < staticidx; i++)
+    heap_snapshot_root (&hs, HEAP_ROOT_STATICPRO, *staticvec[i]);
+  for (struct pinned_object *pobj = pinned_objects; pobj; pobj = pobj->next)
+    heap_snapshot_root (&hs, HEAP_ROOT_PINNED, pobj->object);
+  int lim = (symbol_block_pinned == symbol_block
+	     ? symbol_block_index : SYMBOL_BLOCK_SIZE);
+  for (struct symbol_block *sblk = symbol_block_pinned; sblk;
+       sblk = sblk->next)
+    {
+      struct Lisp_Symbol *sym = sblk->symbols, *end = sym + lim;
+      for (; sym < end; ++sym)
+	if (sym->u.s.pinned)
+	  heap_snapshot_root (&hs, HEAP_ROOT_PINNED, make_lisp_symbol (sym));
+      lim = SYMBOL_BLOCK_SIZE;
+    }
+  for (struct terminal *t = terminal_list; t; t = t->next_terminal)
+    {
+      XSETTERMINAL (tem, t);
+      heap_snapshot_root (&hs, HEAP_ROOT_TERMINAL, tem);
+    }
+  map_kboard_roots (heap_snapshot_kboard_root, &hs);
+  map_regexp_cache_roots (heap_snapshot_regexp_cache_root, &hs);
+  map_thread_roots (heap_snapshot_thread_root, &hs);
+  FOR_EACH_BUFFER (b)
+    {
+      XSETBUFFER (tem, b);
+      heap_snapshot_root (&hs, HEAP_ROOT_BUFFER, tem);
+    }
+
+  while (0 < hs.work_count)
+    {
+      heap_snapshot_object (&hs, hs.work[--hs.work_count]);
+      nobjects++;
+    }
+  putc ('E', hs.stream);
+
+  FILE *stream = hs.stream;
+  hs.stream = NULL;
+  if (ferror (stream) | (fclose (stream) != 0))
+    report_file_error ("Writing heap snapshot", file);
+
+  unbind_to (count, Qnil);
+  return make_number (nobjects);
+}
+
 #ifdef SUSPICIOUS_OBJECT_CHECKING
 
 static void *
@@ -7446,6 +9001,32 @@ do hash-consing of the objects allocated to pure space.  */);
   DEFVAR_LISP ("gc-elapsed", Vgc_elapsed,
 	       doc: /* Accumulated time elapsed in garbage collections.
 The time is in seconds as a floating point value.  */);
+  DEFVAR_LISP ("gc-statistics-log-file", Vgc_statistics_log_file,
+	       doc: /* If non-nil, file to which GC statistics are logged.
+After each garbage collection, the statistics that
+`garbage-collect-statistics' returns for it are appended to this file
+as one line of JSON.  The file is created if it does not exist, and
+errors opening it are ignored.  */);
+  Vgc_statistics_log_file = Qnil;
+  gc_log_name = Qnil;
+  staticpro (&gc_log_name);
+
+  DEFSYM (QCgc, ":gc");
+  DEFSYM (QCstart, ":start");
+  DEFSYM (QCelapsed, ":elapsed");
+  DEFSYM (QCphases, ":phases");
+  DEFSYM (QCfreed, ":freed");
+  DEFSYM (QCreleased, ":released");
+  DEFSYM (QCtrimmed, ":trimmed");
+
+  DEFVAR_LISP ("gc-trim-threshold", Vgc_trim_threshold,
+	       doc: /* Amount of freed memory that makes GC call `malloc-trim'.
+After a garbage collection, if the blocks of Lisp data given back to
+the C library since `malloc-trim' was last called add up to at least
+this many bytes, `malloc-trim' is called.  If nil, it is never called
+automatically.  */);
+  Vgc_trim_threshold = make_number (32 * 1024 * 1024);
+
   DEFVAR_INT ("gcs-done", gcs_done,
               doc: /* Accumulated number of garbage collections done.  */);
 
@@ -7461,7 +9042,10 @@ The time is in seconds as a floating point value.  */);
   defsubr (&Smake_finalizer);
   defsubr (&Spurecopy);
   defsubr (&Sgarbage_collect);
+  defsubr (&Sgarbage_collect_statistics);
   defsubr (&Smemory_limit);
+  defsubr (&Smalloc_trim);
+  defsubr (&Sdump_heap_snapshot);
   defsubr (&Smemory_info);
   defsubr (&Ssuspicious_object);
 }
@@ -438,6 +438,8 @@ even if it is dead.  The return value is never nil.  */)
   BUF_END_UNCHANGED (b) = 0;
   BUF_BEG_UNCHANGED (b) = 0;
   *(BUF_GPT_ADDR (b)) = *(BUF_Z_ADDR (b)) = 0; /* Put an anchor '\0'.  */
+  b->text->charpos_index = NULL;
+  b->text->charpos_index_valid = b->text->charpos_index_size = 0;
   b->text->inhibit_shrinking = false;
   b->text->redisplay = false;
 
@@ -2102,6 +2104,7 @@ current buffer is cleared.  */)
 
   /* If the cached position is for this buffer, clear it out.  */
   clear_charpos_cache (current_buffer);
+  truncate_charpos_index (current_buffer, BEG_BYTE);
 
   if (NILP (flag))
     begv = BEGV_BYTE, zv = ZV_BYTE;
@@ -2174,6 +2177,11 @@ current buffer is cleared.  */)
 	      p += bytes, pos += bytes;
 	    }
 	}
+
+      /* set_intervals_multibyte refilled the charpos index with the
+	 old, multibyte correspondences.  */
+      truncate_charpos_index (current_buffer, BEG_BYTE);
+
       if (narrowed)
 	Fnarrow_to_region (make_number (begv), make_number (zv));
     }
@@ -2313,6 +2321,10 @@ current buffer is cleared.  */)
       /* Do this last, so it can calculate the new correspondences
 	 between chars and bytes.  */
       set_intervals_multibyte (1);
+
+      /* Drop whatever the conversion put in the charpos index while
+	 the text was only partly converted.  */
+      truncate_charpos_index (current_buffer, BEG_BYTE);
     }
 
   if (!EQ (old_undo, Qt))
@@ -3113,123 +3125,125 @@ overlay_strings (ptrdiff_t pos, struct window *w, unsigned char **pstr)
   return 0;
 }
 
-/* Shift overlays in BUF's overlay lists, to center the lists at POS.  */
+/* Return the sort key of overlay OV in overlays_after if BY_START,
+   else in overlays_before.  Both lists are in increasing key order.  */
 
-void
-recenter_overlay_lists (struct buffer *buf, ptrdiff_t pos)
+static ptrdiff_t
+overlay_chain_key (struct Lisp_Overlay *ov, bool by_start)
 {
-  Lisp_Object overlay, beg, end;
-  struct Lisp_Overlay *prev, *tail, *next;
+  return (by_start
+	  ? OVERLAY_POSITION (ov->start)
+	  : - OVERLAY_POSITION (ov->end));
+}
 
-  /* See if anything in overlays_before should move to overlays_after.  */
+/* Merge the overlay chains A and B, both sorted by overlay_chain_key,
+   taking from A first when keys are equal.  */
 
-  /* We don't strictly need prev in this loop; it should always be nil.
-     But we use it for symmetry and in case that should cease to be true
-     with some future change.  */
-  prev = NULL;
-  for (tail = buf->overlays_before; tail; prev = tail, tail = next)
-    {
-      next = tail->next;
-      XSETMISC (overlay, tail);
-      eassert (OVERLAYP (overlay));
+static struct Lisp_Overlay *
+merge_overlay_chains (struct Lisp_Overlay *a, struct Lisp_Overlay *b,
+		      bool by_start)
+{
+  struct Lisp_Overlay *head = NULL, **tail = &head;
 
-      beg = OVERLAY_START (overlay);
-      end = OVERLAY_END (overlay);
+  while (a && b)
+    if (overlay_chain_key (a, by_start) <= overlay_chain_key (b, by_start))
+      {
+	*tail = a;
+	tail = &a->next;
+	a = a->next;
+      }
+    else
+      {
+	*tail = b;
+	tail = &b->next;
+	b = b->next;
+      }
+  *tail = a ? a : b;
+  return head;
+}
 
-      if (OVERLAY_POSITION (end) > pos)
-	{
-	  /* OVERLAY needs to be moved.  */
-	  ptrdiff_t where = OVERLAY_POSITION (beg);
-	  struct Lisp_Overlay *other, *other_prev;
+/* Sort the overlay chain LIST by overlay_chain_key, stably.  */
 
-	  /* Splice the cons cell TAIL out of overlays_before.  */
-	  if (prev)
-	    prev->next = next;
-	  else
-	    set_buffer_overlays_before (buf, next);
+static struct Lisp_Overlay *
+sort_overlay_chain (struct Lisp_Overlay *list, bool by_start)
+{
+  struct Lisp_Overlay *slow, *fast, *second;
 
-	  /* Search thru overlays_after for where to put it.  */
-	  other_prev = NULL;
-	  for (other = buf->overlays_after; other;
-	       other_prev = other, other = other->next)
-	    {
-	      Lisp_Object otherbeg, otheroverlay;
+  if (!list || !list->next)
+    return list;
+  for (slow = list, fast = list->next; fast && fast->next;
+       fast = fast->next->next)
+    slow = slow->next;
+  second = slow->next;
+  slow->next = NULL;
+  return merge_overlay_chains (sort_overlay_chain (list, by_start),
+			       sort_overlay_chain (second, by_start),
+			       by_start);
+}
 
-	      XSETMISC (otheroverlay, other);
-	      eassert (OVERLAYP (otheroverlay));
+/* Shift overlays in BUF's overlay lists, to center the lists at POS.
 
-	      otherbeg = OVERLAY_START (otheroverlay);
-	      if (OVERLAY_POSITION (otherbeg) >= where)
-		break;
-	    }
+   The overlays that change lists are collected first, then sorted and
+   merged into their new list in one pass, so moving K overlays costs
+   O(N + K log K) rather than a search of the other list for each.  */
 
-	  /* Add TAIL to overlays_after before OTHER.  */
-	  tail->next = other;
-	  if (other_prev)
-	    other_prev->next = tail;
-	  else
-	    set_buffer_overlays_after (buf, tail);
-	  tail = prev;
-	}
-      else
-	/* We've reached the things that should stay in overlays_before.
-	   All the rest of overlays_before must end even earlier,
-	   so stop now.  */
-	break;
+void
+recenter_overlay_lists (struct buffer *buf, ptrdiff_t pos)
+{
+  struct Lisp_Overlay *prev, *tail, *next, *moved;
+
+  /* See if anything in overlays_before should move to overlays_after.
+     They are all at the front, since overlays_before is in order of
+     decreasing end position.  Collect them in reverse, so that among
+     equal start positions the last one moved ends up first, as it
+     did when each was inserted individually.  */
+  moved = NULL;
+  for (tail = buf->overlays_before;
+       tail && OVERLAY_POSITION (tail->end) > pos; tail = next)
+    {
+      eassert (OVERLAYP (make_lisp_ptr (tail, Lisp_Misc)));
+      next = tail->next;
+      tail->next = moved;
+      moved = tail;
+    }
+  if (moved)
+    {
+      set_buffer_overlays_before (buf, tail);
+      set_buffer_overlays_after
+	(buf, merge_overlay_chains (sort_overlay_chain (moved, true),
+				    buf->overlays_after, true));
     }
 
   /* See if anything in overlays_after should be in overlays_before.  */
+  moved = NULL;
   prev = NULL;
-  for (tail = buf->overlays_after; tail; prev = tail, tail = next)
+  for (tail = buf->overlays_after; tail; tail = next)
     {
       next = tail->next;
-      XSETMISC (overlay, tail);
-      eassert (OVERLAYP (overlay));
-
-      beg = OVERLAY_START (overlay);
-      end = OVERLAY_END (overlay);
+      eassert (OVERLAYP (make_lisp_ptr (tail, Lisp_Misc)));
 
       /* Stop looking, when we know that nothing further
 	 can possibly end before POS.  */
-      if (OVERLAY_POSITION (beg) > pos)
+      if (OVERLAY_POSITION (tail->start) > pos)
 	break;
 
-      if (OVERLAY_POSITION (end) <= pos)
+      if (OVERLAY_POSITION (tail->end) <= pos)
 	{
-	  /* OVERLAY needs to be moved.  */
-	  ptrdiff_t where = OVERLAY_POSITION (end);
-	  struct Lisp_Overlay *other, *other_prev;
-
-	  /* Splice the cons cell TAIL out of overlays_after.  */
+	  /* Splice TAIL out of overlays_after.  */
 	  if (prev)
 	    prev->next = next;
 	  else
 	    set_buffer_overlays_after (buf, next);
-
-	  /* Search thru overlays_before for where to put it.  */
-	  other_prev = NULL;
-	  for (other = buf->overlays_before; other;
-	       other_prev = other, other = other->next)
-	    {
-	      Lisp_Object otherend, otheroverlay;
-
-	      XSETMISC (otheroverlay, other);
-	      eassert (OVERLAYP (otheroverlay));
-
-	      otherend = OVERLAY_END (otheroverlay);
-	      if (OVERLAY_POSITION (otherend) <= where)
-		break;
-	    }
-
-	  /* Add TAIL to overlays_before before OTHER.  */
-	  tail->next = other;
-	  if (other_prev)
-	    other_prev->next = tail;
-	  else
-	    set_buffer_overlays_before (buf, tail);
-	  tail = prev;
+	  tail->next = moved;
+	  moved = tail;
 	}
+      else
+	prev = tail;
     }
+  if (moved)
+    set_buffer_overlays_before
+      (buf, merge_overlay_chains (sort_overlay_chain (moved, false),
+				  buf->overlays_before, false));
 
   buf->overlay_center = pos;
 }
@@ -4599,10 +4613,198 @@ free_buffer_text (struct buffer *b)
 #endif
 
   BUF_BEG_ADDR (b) = NULL;
+  xfree (b->text->charpos_index);
+  b->text->charpos_index = NULL;
+  b->text->charpos_index_valid = b->text->charpos_index_size = 0;
   unblock_input ();
 }
 
 
+
+
+/***********************************************************************
+			       Buffer Snapshots
+ ***********************************************************************/
+
+/* Return the last checkpoint of snapshot S at or before POS, a byte
+   offset if BY_BYTE, else a character offset.  */
+
+static struct charpos_checkpoint
+buffer_snapshot_checkpoint (struct Lisp_Buffer_Snapshot *s, bool by_byte,
+			    ptrdiff_t pos)
+{
+  static struct charpos_checkpoint const start;
+  ptrdiff_t lo = 0, hi = s->nindex;
+
+  /* Find the first checkpoint after POS.  */
+  while (lo < hi)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      if ((by_byte ? s->index[mid].bytepos : s->index[mid].charpos) <= pos)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo == 0 ? start : s->index[lo - 1];
+}
+
+/* Return the byte offset in the text of snapshot S of the character
+   CHARPOS characters from its start.  */
+
+ptrdiff_t
+buffer_snapshot_char_to_byte (struct Lisp_Buffer_Snapshot *s,
+			      ptrdiff_t charpos)
+{
+  struct charpos_checkpoint cp;
+  ptrdiff_t c, b;
+
+  if (s->nchars == s->nbytes)
+    return charpos;
+  cp = buffer_snapshot_checkpoint (s, false, charpos);
+  for (c = cp.charpos, b = cp.bytepos; c < charpos; c++)
+    b += BYTES_BY_CHAR_HEAD (s->text[b]);
+  return b;
+}
+
+/* Return the number of characters in snapshot S before the byte
+   offset BYTEPOS, which must be at a character boundary.  */
+
+ptrdiff_t
+buffer_snapshot_byte_to_char (struct Lisp_Buffer_Snapshot *s,
+			      ptrdiff_t bytepos)
+{
+  struct charpos_checkpoint cp;
+  ptrdiff_t c, b;
+
+  if (s->nchars == s->nbytes)
+    return bytepos;
+  cp = buffer_snapshot_checkpoint (s, true, bytepos);
+  for (c = cp.charpos, b = cp.bytepos; b < bytepos; c++)
+    b += BYTES_BY_CHAR_HEAD (s->text[b]);
+  return c;
+}
+
+/* Check that START and END are positions in SNAPSHOT, defaulting to
+   its bounds, and store them in *FROM and *TO as character offsets
+   from the start of its text, the smaller one in *FROM.  */
+
+void
+buffer_snapshot_range (Lisp_Object snapshot, Lisp_Object start,
+		       Lisp_Object end, ptrdiff_t *from, ptrdiff_t *to)
+{
+  struct Lisp_Buffer_Snapshot *s;
+  EMACS_INT b, e;
+
+  CHECK_BUFFER_SNAPSHOT (snapshot);
+  s = XBUFFER_SNAPSHOT (snapshot);
+  if (NILP (start))
+    b = s->beg;
+  else
+    {
+      CHECK_NUMBER_COERCE_MARKER (start);
+      b = XINT (start);
+    }
+  if (NILP (end))
+    e = s->beg + s->nchars;
+  else
+    {
+      CHECK_NUMBER_COERCE_MARKER (end);
+      e = XINT (end);
+    }
+  if (b > e)
+    {
+      EMACS_INT tem = b;
+      b = e;
+      e = tem;
+    }
+  if (! (s->beg <= b && e <= s->beg + s->nchars))
+    args_out_of_range (start, end);
+  *from = b - s->beg;
+  *to = e - s->beg;
+}
+
+DEFUN ("buffer-snapshot", Fbuffer_snapshot, Sbuffer_snapshot, 0, 1, 0,
+       doc: /* Return a read-only copy of the accessible text of BUFFER.
+BUFFER defaults to the current buffer.  The copy keeps the buffer
+positions the text had when it was made, and does not change when the
+buffer is edited afterwards.  Text properties are not copied.
+
+Use `buffer-snapshot-string' to extract text from the copy and
+`buffer-snapshot-search' to search it.  `secure-hash' accepts it in
+place of a buffer.  */)
+  (Lisp_Object buffer)
+{
+  struct buffer *b = decode_buffer (buffer);
+  struct Lisp_Buffer_Snapshot *s;
+  ptrdiff_t beg_byte, end_byte, gpt_byte;
+
+  if (!BUFFER_LIVE_P (b))
+    error ("Attempt to copy the text of a killed buffer");
+
+  beg_byte = BUF_BEGV_BYTE (b);
+  end_byte = BUF_ZV_BYTE (b);
+  gpt_byte = clip_to_bounds (beg_byte, BUF_GPT_BYTE (b), end_byte);
+
+  s = ALLOCATE_ZEROED_PSEUDOVECTOR (struct Lisp_Buffer_Snapshot, buffer,
+				    PVEC_BUFFER_SNAPSHOT);
+  XSETBUFFER (s->buffer, b);
+  s->text = xmalloc (end_byte - beg_byte + 1);
+  s->nbytes = end_byte - beg_byte;
+  s->nchars = BUF_ZV (b) - BUF_BEGV (b);
+  s->beg = BUF_BEGV (b);
+  s->multibyte = !NILP (BVAR (b, enable_multibyte_characters));
+
+  /* Copy the text on each side of the gap.  */
+  memcpy (s->text, BUF_BYTE_ADDRESS (b, beg_byte), gpt_byte - beg_byte);
+  memcpy (s->text + (gpt_byte - beg_byte), BUF_BYTE_ADDRESS (b, gpt_byte),
+	  end_byte - gpt_byte);
+  s->text[s->nbytes] = 0;
+
+  /* Take the checkpoints for converting positions from the buffer, so
+     that the snapshot need not be scanned from its start.  The snapshot
+     itself is never written to afterwards.  */
+  if (s->nchars != s->nbytes)
+    {
+      ptrdiff_t i;
+
+      s->nindex = copy_charpos_index (b, beg_byte, end_byte, &s->index);
+      for (i = 0; i < s->nindex; i++)
+	{
+	  s->index[i].charpos -= s->beg;
+	  s->index[i].bytepos -= beg_byte;
+	}
+    }
+
+  return make_lisp_ptr (s, Lisp_Vectorlike);
+}
+
+DEFUN ("buffer-snapshot-p", Fbuffer_snapshot_p, Sbuffer_snapshot_p, 1, 1, 0,
+       doc: /* Return t if OBJECT is a buffer snapshot.
+See `buffer-snapshot'.  */)
+  (Lisp_Object object)
+{
+  return BUFFER_SNAPSHOTP (object) ? Qt : Qnil;
+}
+
+DEFUN ("buffer-snapshot-string", Fbuffer_snapshot_string,
+       Sbuffer_snapshot_string, 1, 3, 0,
+       doc: /* Return the text of SNAPSHOT between START and END as a string.
+START and END are buffer positions as they were when `buffer-snapshot'
+made SNAPSHOT, and default to the bounds of its text.  */)
+  (Lisp_Object snapshot, Lisp_Object start, Lisp_Object end)
+{
+  struct Lisp_Buffer_Snapshot *s;
+  ptrdiff_t from, to, from_byte, to_byte;
+
+  buffer_snapshot_range (snapshot, start, end, &from, &to);
+  s = XBUFFER_SNAPSHOT (snapshot);
+  from_byte = buffer_snapshot_char_to_byte (s, from);
+  to_byte = buffer_snapshot_char_to_byte (s, to);
+  return make_specified_string ((char *) s->text + from_byte, to - from,
+				to_byte - from_byte, s->multibyte);
+}
+
+
 
 /***********************************************************************
 			    Initialization
@@ -4993,6 +5195,7 @@ syms_of_buffer (void)
 
   DEFSYM (Qpermanent_local_hook, "permanent-local-hook");
   DEFSYM (Qoverlayp, "overlayp");
+  DEFSYM (Qbuffer_snapshot_p, "buffer-snapshot-p");
   DEFSYM (Qevaporate, "evaporate");
   DEFSYM (Qmodification_hooks, "modification-hooks");
   DEFSYM (Qinsert_in_front_hooks, "insert-in-front-hooks");
@@ -5813,6 +6016,10 @@ Functions running this hook are, `get-buffer-create',
   defsubr (&Soverlay_put);
   defsubr (&Srestore_buffer_modified_p);
 
+  defsubr (&Sbuffer_snapshot);
+  defsubr (&Sbuffer_snapshot_p);
+  defsubr (&Sbuffer_snapshot_string);
+
   Fput (intern_c_string ("erase-buffer"), Qdisabled, Qt);
 }
 
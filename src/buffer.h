@@ -429,6 +429,19 @@ extern void enlarge_buffer_text (struct buffer *, ptrdiff_t);
 
 /* Define the actual buffer data structures.  */
 
+/* A known correspondence between a character and a byte position,
+   kept in the charpos index of struct buffer_text, together with the
+   number of newlines before it.  */
+
+struct charpos_checkpoint
+{
+  ptrdiff_t charpos, bytepos, newlines;
+};
+
+/* The distance in bytes between the checkpoints of the charpos index.  */
+
+enum { CHARPOS_INDEX_STRIDE = 4096 };
+
 /* This data structure describes the actual text contents of a buffer.
    It is shared between indirect buffers and their base buffer.  */
 
@@ -488,6 +501,16 @@ struct buffer_text
        to move a marker within a buffer.  */
     struct Lisp_Marker *markers;
 
+    /* Sparse index for converting between character and byte
+       positions in a multibyte buffer, and for counting lines.
+       Checkpoint K is at the first character boundary at or after byte
+       BEG_BYTE + K * CHARPOS_INDEX_STRIDE.  The index is extended on
+       demand, and an edit drops the checkpoints after the edited
+       position, so only the first CHARPOS_INDEX_VALID entries are
+       meaningful.  */
+    struct charpos_checkpoint *charpos_index;
+    ptrdiff_t charpos_index_valid, charpos_index_size;
+
     /* Usually false.  Temporarily true in decode_coding_gap to
        prevent Fgarbage_collect from shrinking the gap and losing
        not-yet-decoded bytes.  */
@@ -886,7 +909,15 @@ struct buffer
      in order of start-position.  */
   struct Lisp_Overlay *overlays_after;
 
-  /* Position where the overlay lists are centered.  */
+  /* Position where the overlay lists are centered.
+
+     Queries such as overlays_at, overlays_in and next_overlay_change
+     walk these lists, so they take time linear in the number of
+     overlays on the far side of the center.  An interval tree would
+     answer them in logarithmic time.  But these two lists are read and
+     spliced directly by buffer.c, alloc.c, editfns.c, fileio.c,
+     insdel.c, print.c, xdisp.c and the Rust buffer code, so they are
+     kept as they are.  */
   ptrdiff_t overlay_center;
 
   /* Changes in the buffer are recorded here for undo, and t means
@@ -924,6 +955,60 @@ XBUFFER (Lisp_Object a)
   return XUNTAG (a, Lisp_Vectorlike);
 }
 
+/* A read-only copy of the accessible text of a buffer, made by
+   `buffer-snapshot'.  The text has no gap and is never changed or
+   moved once the snapshot exists, so it can be searched and hashed
+   while the buffer it came from is being edited.  Text properties
+   are not copied.  */
+
+struct Lisp_Buffer_Snapshot
+{
+  union vectorlike_header header;
+
+  /* The buffer the text was copied from.  */
+  Lisp_Object buffer;
+
+  /* The remaining fields are not traced by GC.  */
+
+  /* The text, NBYTES bytes followed by a null byte, in xmalloc'd
+     memory freed when the snapshot is garbage-collected.  */
+  unsigned char *text;
+  ptrdiff_t nchars, nbytes;
+
+  /* The buffer position that the first character had, so that
+     positions in the snapshot are those of the buffer at the time
+     the snapshot was made.  */
+  ptrdiff_t beg;
+
+  /* For converting between character and byte offsets in multibyte
+     text, the checkpoints of the buffer's charpos index that fell
+     within the text, with positions made relative to its start.
+     NINDEX entries in xmalloc'd memory, freed with the snapshot.  */
+  struct charpos_checkpoint *index;
+  ptrdiff_t nindex;
+
+  bool_bf multibyte : 1;
+};
+
+INLINE bool
+BUFFER_SNAPSHOTP (Lisp_Object a)
+{
+  return PSEUDOVECTORP (a, PVEC_BUFFER_SNAPSHOT);
+}
+
+INLINE void
+CHECK_BUFFER_SNAPSHOT (Lisp_Object x)
+{
+  CHECK_TYPE (BUFFER_SNAPSHOTP (x), Qbuffer_snapshot_p, x);
+}
+
+INLINE struct Lisp_Buffer_Snapshot *
+XBUFFER_SNAPSHOT (Lisp_Object a)
+{
+  eassert (BUFFER_SNAPSHOTP (a));
+  return XUNTAG (a, Lisp_Vectorlike);
+}
+
 /* Most code should use these functions to set Lisp fields in struct
    buffer.  (Some setters that are private to a single .c file are
    defined as static in those files.)  */
@@ -1145,6 +1230,14 @@ extern void record_buffer (Lisp_Object);
 extern void fix_overlays_before (struct buffer *, ptrdiff_t, ptrdiff_t);
 extern void mmap_set_vars (bool);
 extern void restore_buffer (Lisp_Object);
+extern ptrdiff_t buffer_snapshot_char_to_byte (struct Lisp_Buffer_Snapshot *,
+					      ptrdiff_t);
+extern ptrdiff_t buffer_snapshot_byte_to_char (struct Lisp_Buffer_Snapshot *,
+					      ptrdiff_t);
+extern void buffer_snapshot_range (Lisp_Object, Lisp_Object, Lisp_Object,
+				   ptrdiff_t *, ptrdiff_t *);
+extern ptrdiff_t copy_charpos_index (struct buffer *, ptrdiff_t, ptrdiff_t,
+				     struct charpos_checkpoint **);
 extern void set_buffer_if_live (Lisp_Object);
 
 /* Return B as a struct buffer pointer, defaulting to the current buffer.  */
@@ -2163,6 +2163,7 @@ syms_of_data (void)
   DEFSYM (Qsubr, "subr");
   DEFSYM (Qcompiled_function, "compiled-function");
   DEFSYM (Qbuffer, "buffer");
+  DEFSYM (Qbuffer_snapshot, "buffer-snapshot");
   DEFSYM (Qframe, "frame");
   DEFSYM (Qvector, "vector");
   DEFSYM (Qrecord, "record");
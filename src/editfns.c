@@ -3431,6 +3431,8 @@ transpose_markers (ptrdiff_t start1, ptrdiff_t end1,
   register ptrdiff_t amt1, amt1_byte, amt2, amt2_byte, diff, diff_byte, mpos;
   register struct Lisp_Marker *marker;
 
+  truncate_charpos_index (current_buffer, start1_byte);
+
   /* Update point as if it were a marker.  */
   if (PT < start1)
     ;
@@ -2908,6 +2908,49 @@ mark_specpdl (union specbinding *first, union specbinding *ptr)
     }
 }
 
+/* Call FN with DATA on every object that mark_specpdl would mark in
+   the bindings from FIRST to PTR.  */
+
+void
+map_specpdl (union specbinding *first, union specbinding *ptr,
+	     void (*fn) (Lisp_Object, void *), void *data)
+{
+  union specbinding *pdl;
+  for (pdl = first; pdl != ptr; pdl++)
+    {
+      switch (pdl->kind)
+	{
+	case SPECPDL_UNWIND:
+	  fn (specpdl_arg (pdl), data);
+	  break;
+
+	case SPECPDL_BACKTRACE:
+	  {
+	    ptrdiff_t nargs = backtrace_nargs (pdl);
+	    fn (backtrace_function (pdl), data);
+	    if (nargs == UNEVALLED)
+	      nargs = 1;
+	    while (nargs--)
+	      fn (backtrace_args (pdl)[nargs], data);
+	  }
+	  break;
+
+	case SPECPDL_LET_DEFAULT:
+	case SPECPDL_LET_LOCAL:
+	  fn (specpdl_where (pdl), data);
+	  FALLTHROUGH;
+	case SPECPDL_LET:
+	  fn (specpdl_symbol (pdl), data);
+	  fn (specpdl_old_value (pdl), data);
+	  fn (specpdl_saved_value (pdl), data);
+	  break;
+
+	default:
+	  break;
+	}
+    }
+}
+
 void
 get_backtrace (Lisp_Object array)
 {
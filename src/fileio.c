@@ -3162,6 +3162,16 @@ otherwise, if FILE2 does not exist, the answer is t.  */)
 
 enum { READ_BUF_SIZE = MAX_ALLOCA };
 
+/* How many bytes of a regular file insert-file-contents reads into the
+   gap at a time.  The data does not go through READ_BUF, so this can
+   be much larger, and then a big file takes few system calls.
+
+   The whole file still ends up in the buffer text, decoded.  Backing a
+   read-only buffer with a mapping of the file instead would need every
+   reader of buffer text to fetch it through an accessor that can
+   decode on demand, rather than through BYTE_POS_ADDR and the gap.  */
+enum { GAP_READ_SIZE = 1024 * 1024 };
+
 /* This function is called after Lisp functions to decide a coding
    system are called, or when they cause an error.  Before they are
    called, the current buffer is set unibyte and it contains only a
@@ -4041,6 +4051,12 @@ by calling `format-decode', which see.  */)
   /* Total bytes inserted.  */
   inserted = 0;
 
+#ifdef HAVE_POSIX_FADVISE
+  /* We are going to read the whole range once, front to back.  */
+  if (! not_regular && total > GAP_READ_SIZE)
+    posix_fadvise (fd, beg_offset, total, POSIX_FADV_SEQUENTIAL);
+#endif
+
   /* Here, we don't do code conversion in the loop.  It is done by
      decode_coding_gap after all data are read into the buffer.  */
   {
@@ -4049,7 +4065,8 @@ by calling `format-decode', which see.  */)
     while (how_much < total)
       {
 	/* `try' is reserved in some compilers (Microsoft C).  */
-	ptrdiff_t trytry = min (total - how_much, READ_BUF_SIZE);
+	ptrdiff_t trytry = min (total - how_much,
+				not_regular ? READ_BUF_SIZE : GAP_READ_SIZE);
 	ptrdiff_t this;
 
 	if (not_regular)
@@ -1896,6 +1896,47 @@ The data read from the system are decoded using `locale-coding-system'.  */)
   return Qnil;
 }
 
+DEFUN ("line-number-at-pos", Fline_number_at_pos, Sline_number_at_pos,
+       0, 2, 0,
+       doc: /* Return buffer line number at position POS.
+If POS is nil, use current buffer location.
+
+If ABSOLUTE is nil, the default, counting starts
+at (point-min), so the value refers to the contents of the
+accessible portion of the (potentially narrowed) buffer.  If
+ABSOLUTE is non-nil, ignore any narrowing and return the
+absolute line number.  */)
+  (Lisp_Object pos, Lisp_Object absolute)
+{
+  ptrdiff_t charpos, start_byte, pos_byte;
+
+  if (NILP (pos))
+    charpos = PT;
+  else
+    {
+      CHECK_NUMBER_COERCE_MARKER (pos);
+      charpos = XINT (pos);
+    }
+
+  if (NILP (absolute))
+    {
+      start_byte = BEGV_BYTE;
+      charpos = clip_to_bounds (BEGV, charpos, ZV);
+    }
+  else
+    {
+      start_byte = BEG_BYTE;
+      charpos = clip_to_bounds (BEG, charpos, Z);
+    }
+  pos_byte = CHAR_TO_BYTE (charpos);
+
+  /* Once the buffer's line index is built, each of these costs at
+     most a scan of one stride of the index.  */
+  return make_number (buf_newlines_before (current_buffer, pos_byte)
+		      - buf_newlines_before (current_buffer, start_byte)
+		      + 1);
+}
+
 /* base64 encode/decode functions (RFC 2045).
    Based on code from GNU recode. */
 
@@ -3296,6 +3337,40 @@ extract_data_from_object (Lisp_Object spec,
       *start_byte = 0;
       *end_byte = SBYTES (object);
     }
+  else if (BUFFER_SNAPSHOTP (object))
+    {
+      struct Lisp_Buffer_Snapshot *s = XBUFFER_SNAPSHOT (object);
+      ptrdiff_t from, to, from_byte, to_byte;
+
+      buffer_snapshot_range (object, start, end, &from, &to);
+      from_byte = buffer_snapshot_char_to_byte (s, from);
+      to_byte = buffer_snapshot_char_to_byte (s, to);
+
+      if (NILP (coding_system))
+	coding_system = s->multibyte ? preferred_coding_system () : Qraw_text;
+      if (NILP (Fcoding_system_p (coding_system)))
+	{
+	  if (!NILP (noerror))
+	    coding_system = Qraw_text;
+	  else
+	    xsignal1 (Qcoding_system_error, coding_system);
+	}
+
+      /* Unibyte text is hashed in place; multibyte text is encoded,
+	 as for a string.  */
+      if (!s->multibyte)
+	{
+	  *start_byte = from_byte;
+	  *end_byte = to_byte;
+	  return (char *) s->text;
+	}
+
+      object = make_specified_string ((char *) s->text + from_byte, to - from,
+				      to_byte - from_byte, true);
+      object = code_convert_string (object, coding_system, Qnil, 1, 0, 1);
+      *start_byte = 0;
+      *end_byte = SBYTES (object);
+    }
   else if (EQ (object, Qiv_auto))
     {
 #ifdef HAVE_GNUTLS3
@@ -3441,4 +3516,5 @@ this variable.  */);
   defsubr (&Sbase64_decode_region);
   defsubr (&Ssecure_hash_algorithms);
   defsubr (&Slocale_info);
+  defsubr (&Sline_number_at_pos);
 }
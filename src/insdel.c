@@ -226,12 +226,315 @@ adjust_suspend_auto_hscroll (ptrdiff_t from, ptrdiff_t to)
 }
 
 
+/* The charpos index of a buffer's text.  See struct buffer_text.  */
+
+/* Drop the checkpoints of B's charpos index that lie after byte
+   position BYTEPOS, which is about to change or has changed.  Text
+   before BYTEPOS, and so the checkpoints there, are unaffected.  */
+
+void
+truncate_charpos_index (struct buffer *b, ptrdiff_t bytepos)
+{
+  struct buffer_text *t = b->text;
+  ptrdiff_t n = min (t->charpos_index_valid,
+		     (bytepos - BEG_BYTE) / CHARPOS_INDEX_STRIDE + 1);
+
+  /* Checkpoint N - 1 is at most a character's length past its stride
+     boundary, so it is the only one that can still be after BYTEPOS.  */
+  if (0 < n && bytepos < t->charpos_index[n - 1].bytepos)
+    n--;
+  t->charpos_index_valid = max (n, 0);
+}
+
+/* Count the characters and the newlines in B between byte positions
+   FROM and TO, which must both be character boundaries, and add them
+   to *NCHARS and *NLINES.  */
+
+static void
+count_chars_and_lines (struct buffer *b, ptrdiff_t from, ptrdiff_t to,
+		       ptrdiff_t *nchars, ptrdiff_t *nlines)
+{
+  bool multibyte = !NILP (BVAR (b, enable_multibyte_characters));
+
+  while (from < to)
+    {
+      ptrdiff_t end = (from < BUF_GPT_BYTE (b)
+		       ? min (to, BUF_GPT_BYTE (b)) : to);
+      unsigned char const *p = BUF_BYTE_ADDRESS (b, from);
+      ptrdiff_t heads = 0, newlines = 0;
+      for (ptrdiff_t i = 0; i < end - from; i++)
+	{
+	  heads += CHAR_HEAD_P (p[i]);
+	  newlines += p[i] == '\n';
+	}
+      *nchars += multibyte ? heads : end - from;
+      *nlines += newlines;
+      from = end;
+    }
+}
+
+/* Return the number of newlines in B between byte positions FROM and
+   TO.  */
+
+static ptrdiff_t
+count_newline_bytes (struct buffer *b, ptrdiff_t from, ptrdiff_t to)
+{
+  ptrdiff_t nlines = 0;
+
+  while (from < to)
+    {
+      ptrdiff_t end = (from < BUF_GPT_BYTE (b)
+		       ? min (to, BUF_GPT_BYTE (b)) : to);
+      nlines += count_newlines (BUF_BYTE_ADDRESS (b, from), end - from);
+      from = end;
+    }
+  return nlines;
+}
+
+/* Add checkpoints to B's charpos index until it has one past POS, or
+   reaches the end of the text.  POS is a byte position if BY_BYTE,
+   else a character position.  */
+
+static void
+extend_charpos_index (struct buffer *b, bool by_byte, ptrdiff_t pos)
+{
+  struct buffer_text *t = b->text;
+  ptrdiff_t n = t->charpos_index_valid;
+  ptrdiff_t charpos, bytepos, newlines;
+  bool multibyte = !NILP (BVAR (b, enable_multibyte_characters));
+
+  if (n == 0)
+    {
+      if (!t->charpos_index)
+	t->charpos_index = xpalloc (NULL, &t->charpos_index_size, 1, -1,
+				    sizeof *t->charpos_index);
+      t->charpos_index[0].charpos = BUF_BEG (b);
+      t->charpos_index[0].bytepos = BUF_BEG_BYTE (b);
+      t->charpos_index[0].newlines = 0;
+      n = 1;
+    }
+  charpos = t->charpos_index[n - 1].charpos;
+  bytepos = t->charpos_index[n - 1].bytepos;
+  newlines = t->charpos_index[n - 1].newlines;
+
+  while ((by_byte ? bytepos : charpos) <= pos)
+    {
+      ptrdiff_t next = BUF_BEG_BYTE (b) + n * CHARPOS_INDEX_STRIDE;
+      if (BUF_Z_BYTE (b) <= next)
+	break;
+      while (multibyte && !CHAR_HEAD_P (*BUF_BYTE_ADDRESS (b, next)))
+	next++;
+      count_chars_and_lines (b, bytepos, next, &charpos, &newlines);
+      bytepos = next;
+      if (n == t->charpos_index_size)
+	t->charpos_index = xpalloc (t->charpos_index, &t->charpos_index_size,
+				    1, -1, sizeof *t->charpos_index);
+      t->charpos_index[n].charpos = charpos;
+      t->charpos_index[n].bytepos = bytepos;
+      t->charpos_index[n].newlines = newlines;
+      n++;
+    }
+  t->charpos_index_valid = n;
+}
+
+/* Store in *INDEX an xmalloc'd copy of the checkpoints of B's charpos
+   index between byte positions FROM and TO inclusive, and return how
+   many there are.  Extend the index up to TO first.  */
+
+ptrdiff_t
+copy_charpos_index (struct buffer *b, ptrdiff_t from, ptrdiff_t to,
+		    struct charpos_checkpoint **index)
+{
+  struct buffer_text *t = b->text;
+  ptrdiff_t n, first, last;
+
+  extend_charpos_index (b, true, to);
+  n = t->charpos_index_valid;
+
+  /* As in truncate_charpos_index, a checkpoint is at most a character's
+     length past its stride boundary.  */
+  first = min ((from - BUF_BEG_BYTE (b)) / CHARPOS_INDEX_STRIDE, n);
+  while (first < n && t->charpos_index[first].bytepos < from)
+    first++;
+  for (last = first; last < n && t->charpos_index[last].bytepos <= to; last++)
+    continue;
+
+  *index = xnmalloc (last - first, sizeof **index);
+  memcpy (*index, t->charpos_index + first, (last - first) * sizeof **index);
+  return last - first;
+}
+
+/* Find the checkpoints of B's charpos index around POS, a byte
+   position if BY_BYTE, else a character position.  BELOW and ABOVE
+   are the closest positions around POS that the caller already knows,
+   in the same unit.  If the index does not reach POS yet, extend it,
+   but only if that is not much more work than scanning the text from
+   BELOW or ABOVE.  Store the checkpoint at or before POS in
+   *CHARPOS_BELOW and *BYTEPOS_BELOW, and the one after POS (or the end
+   of the text) in *CHARPOS_ABOVE and *BYTEPOS_ABOVE.  Return false if
+   the index has nothing better to offer.  */
+
+bool
+charpos_index_lookup (struct buffer *b, bool by_byte, ptrdiff_t pos,
+		      ptrdiff_t below, ptrdiff_t above,
+		      ptrdiff_t *charpos_below, ptrdiff_t *bytepos_below,
+		      ptrdiff_t *charpos_above, ptrdiff_t *bytepos_above)
+{
+  struct buffer_text *t = b->text;
+  struct charpos_checkpoint *cp = t->charpos_index;
+  ptrdiff_t n = t->charpos_index_valid, k;
+
+#define CHECKPOINT_POS(i) (by_byte ? cp[i].bytepos : cp[i].charpos)
+
+  if (n == 0 || CHECKPOINT_POS (n - 1) <= pos)
+    {
+      ptrdiff_t last = (n == 0 ? (by_byte ? BUF_BEG_BYTE (b) : BUF_BEG (b))
+			: CHECKPOINT_POS (n - 1));
+      if (min (pos - below, above - pos) + CHARPOS_INDEX_STRIDE < pos - last)
+	return false;
+      extend_charpos_index (b, by_byte, pos);
+      cp = t->charpos_index;
+      n = t->charpos_index_valid;
+    }
+
+  /* Find the last checkpoint at or before POS.  Checkpoint 0 is at the
+     beginning of the text, so there is one.  */
+  if (by_byte)
+    {
+      k = min ((pos - BUF_BEG_BYTE (b)) / CHARPOS_INDEX_STRIDE, n - 1);
+      if (pos < cp[k].bytepos)
+	k--;
+    }
+  else
+    {
+      ptrdiff_t lo = 0, hi = n;
+      while (hi - lo > 1)
+	{
+	  ptrdiff_t mid = lo + (hi - lo) / 2;
+	  if (cp[mid].charpos <= pos)
+	    lo = mid;
+	  else
+	    hi = mid;
+	}
+      k = lo;
+    }
+
+#undef CHECKPOINT_POS
+
+  *charpos_below = cp[k].charpos;
+  *bytepos_below = cp[k].bytepos;
+  if (k + 1 < n)
+    {
+      *charpos_above = cp[k + 1].charpos;
+      *bytepos_above = cp[k + 1].bytepos;
+    }
+  else
+    {
+      *charpos_above = BUF_Z (b);
+      *bytepos_above = BUF_Z_BYTE (b);
+    }
+  return true;
+}
+
+/* Return the number of newlines in B before byte position BYTEPOS,
+   extending B's charpos index up to BYTEPOS if needed.  */
+
+ptrdiff_t
+buf_newlines_before (struct buffer *b, ptrdiff_t bytepos)
+{
+  struct buffer_text *t = b->text;
+  ptrdiff_t k;
+
+  extend_charpos_index (b, true, bytepos);
+  k = min ((bytepos - BUF_BEG_BYTE (b)) / CHARPOS_INDEX_STRIDE,
+	   t->charpos_index_valid - 1);
+  if (bytepos < t->charpos_index[k].bytepos)
+    k--;
+  return (t->charpos_index[k].newlines
+	  + count_newline_bytes (b, t->charpos_index[k].bytepos, bytepos));
+}
+
+/* Help find_newline to find the *COUNTth newline after *CHARPOS and
+   *BYTEPOS in B, and no further than END_BYTE, by skipping whole
+   strides of B's charpos index that do not contain it.  If that is
+   possible, move *CHARPOS and *BYTEPOS forward, decrease *COUNT by the
+   number of newlines skipped over and return true.  The index is
+   extended forward as needed, but only if it already reaches close to
+   *BYTEPOS: indexing all the text before *BYTEPOS just to find a few
+   newlines after it would cost more than it saves.  */
+
+bool
+line_index_skip (struct buffer *b, ptrdiff_t end_byte, ptrdiff_t *count,
+		 ptrdiff_t *charpos, ptrdiff_t *bytepos)
+{
+  struct buffer_text *t = b->text;
+  ptrdiff_t start_byte = *bytepos;
+  ptrdiff_t last, base, lo, hi;
+
+  if (end_byte - start_byte < 2 * CHARPOS_INDEX_STRIDE)
+    return false;
+  last = (t->charpos_index_valid == 0 ? BUF_BEG_BYTE (b)
+	  : t->charpos_index[t->charpos_index_valid - 1].bytepos);
+  if (start_byte - last > CHARPOS_INDEX_STRIDE)
+    return false;
+
+  base = buf_newlines_before (b, start_byte);
+
+  /* Checkpoint LO is the last one known to be before the newline we
+     look for, and HI the first one known not to be.  Checkpoint
+     (START_BYTE - BEG_BYTE) / CHARPOS_INDEX_STRIDE is at or before
+     START_BYTE; those after it are candidates.  */
+#define BEFORE_TARGET(k)					\
+  (t->charpos_index[k].bytepos <= end_byte			\
+   && t->charpos_index[k].newlines - base < *count)
+
+  lo = (start_byte - BUF_BEG_BYTE (b)) / CHARPOS_INDEX_STRIDE;
+  hi = t->charpos_index_valid;
+  if (lo + 1 < hi && BEFORE_TARGET (hi - 1))
+    lo = hi - 1;
+  while (hi - lo > 1)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      if (BEFORE_TARGET (mid))
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  /* If every indexed checkpoint is before the target, index on.  */
+  while (lo + 1 == t->charpos_index_valid)
+    {
+      extend_charpos_index (b, true, t->charpos_index[lo].bytepos);
+      if (lo + 1 == t->charpos_index_valid || !BEFORE_TARGET (lo + 1))
+	break;
+      lo++;
+    }
+
+#undef BEFORE_TARGET
+
+  if (t->charpos_index[lo].bytepos <= start_byte)
+    return false;
+  *count -= t->charpos_index[lo].newlines - base;
+  *charpos = t->charpos_index[lo].charpos;
+  *bytepos = t->charpos_index[lo].bytepos;
+  return true;
+}
+
+
 /* Adjust all markers for a deletion
    whose range in bytes is FROM_BYTE to TO_BYTE.
    The range in charpos is FROM to TO.
 
    This function assumes that the gap is adjacent to
-   or inside of the range being deleted.  */
+   or inside of the range being deleted.
+
+   Like the other marker adjustments below, this visits every marker
+   of the buffer, so an edit costs time proportional to the number of
+   markers.  Storing markers in an ordered tree with relative offsets
+   would make this logarithmic, but BUF_MARKERS is a plain linked list
+   that is walked, spliced and unchained directly in buffer.c,
+   editfns.c, undo.c, coding.c and the Rust marker code.  All of those
+   would have to change together.  */
 
 void
 adjust_markers_for_delete (ptrdiff_t from, ptrdiff_t from_byte,
@@ -241,6 +544,7 @@ adjust_markers_for_delete (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t charpos;
 
   adjust_suspend_auto_hscroll (from, to);
+  truncate_charpos_index (current_buffer, from_byte);
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       charpos = m->charpos;
@@ -281,6 +585,7 @@ adjust_markers_for_insert (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t nbytes = to_byte - from_byte;
 
   adjust_suspend_auto_hscroll (from, to);
+  truncate_charpos_index (current_buffer, from_byte);
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       eassert (m->bytepos >= m->charpos
@@ -347,6 +652,7 @@ adjust_markers_for_replace (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t diff_bytes = new_bytes - old_bytes;
 
   adjust_suspend_auto_hscroll (from, from + old_chars);
+  truncate_charpos_index (current_buffer, from_byte);
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       if (m->bytepos >= prev_to_byte)
@@ -399,6 +705,7 @@ adjust_markers_bytepos (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t beg = from, begbyte = from_byte;
 
   adjust_suspend_auto_hscroll (from, to);
+  truncate_charpos_index (current_buffer, from_byte);
 
   if (Z == Z_BYTE || (!to_z && to == to_byte))
     {
@@ -458,8 +765,13 @@ make_gap_larger (ptrdiff_t nbytes_added)
     buffer_overflow ();
 
   /* If we have to get more space, get enough to last a while;
-     but do not exceed the maximum buffer size.  */
-  nbytes_added = min (nbytes_added + GAP_BYTES_DFL,
+     but do not exceed the maximum buffer size.  Each enlargement
+     reallocates the text and moves everything after the gap, so
+     reserve space in proportion to the size of the buffer: a buffer
+     that keeps growing then pays a constant amortized cost per byte
+     inserted, not one proportional to its size.  compact_buffer gives
+     the excess back.  */
+  nbytes_added = min (nbytes_added + max (GAP_BYTES_DFL, current_size / 8),
 		      BUF_BYTES_MAX - current_size);
 
   enlarge_buffer_text (current_buffer, nbytes_added);
@@ -1880,6 +2192,10 @@ modify_text (ptrdiff_t start, ptrdiff_t end)
 {
   prepare_to_modify_buffer (start, end, NULL);
 
+  /* The text is about to change in place, which does not go through
+     the adjust_markers_* functions.  */
+  truncate_charpos_index (current_buffer, CHAR_TO_BYTE (start));
+
   BUF_COMPUTE_UNCHANGED (current_buffer, start - 1, end);
   if (MODIFF <= SAVE_MODIFF)
     record_first_change ();
@@ -2170,6 +2486,10 @@ signal_after_change (ptrdiff_t charpos, ptrdiff_t lendel, ptrdiff_t lenins)
   ptrdiff_t count = SPECPDL_INDEX ();
   struct rvoe_arg rvoe_arg;
 
+  /* Changes made in place may have been indexed mid-way, for example
+     by hooks run by record_change.  */
+  truncate_charpos_index (current_buffer, CHAR_TO_BYTE (charpos));
+
   if (inhibit_modification_hooks)
     return;
 
@@ -11687,10 +11687,10 @@ keys_of_keyboard (void)
 			    "handle-move-frame");
 }
 
-/* Mark the pointers in the kboard objects.
-   Called by Fgarbage_collect.  */
+/* Call FN on each Lisp object referenced from the kboard objects and
+   the keyboard event queue, passing DATA along.  */
 void
-mark_kboards (void)
+map_kboard_roots (void (*fn) (Lisp_Object, void *), void *data)
 {
   KBOARD *kb;
   Lisp_Object *p;
@@ -11698,25 +11698,25 @@ mark_kboards (void)
     {
       if (kb->kbd_macro_buffer)
 	for (p = kb->kbd_macro_buffer; p < kb->kbd_macro_ptr; p++)
-	  mark_object (*p);
-      mark_object (KVAR (kb, Voverriding_terminal_local_map));
-      mark_object (KVAR (kb, Vlast_command));
-      mark_object (KVAR (kb, Vreal_last_command));
-      mark_object (KVAR (kb, Vkeyboard_translate_table));
-      mark_object (KVAR (kb, Vlast_repeatable_command));
-      mark_object (KVAR (kb, Vprefix_arg));
-      mark_object (KVAR (kb, Vlast_prefix_arg));
-      mark_object (KVAR (kb, kbd_queue));
-      mark_object (KVAR (kb, defining_kbd_macro));
-      mark_object (KVAR (kb, Vlast_kbd_macro));
-      mark_object (KVAR (kb, Vsystem_key_alist));
-      mark_object (KVAR (kb, system_key_syms));
-      mark_object (KVAR (kb, Vwindow_system));
-      mark_object (KVAR (kb, Vinput_decode_map));
-      mark_object (KVAR (kb, Vlocal_function_key_map));
-      mark_object (KVAR (kb, Vdefault_minibuffer_frame));
-      mark_object (KVAR (kb, echo_string));
-      mark_object (KVAR (kb, echo_prompt));
+	  fn (*p, data);
+      fn (KVAR (kb, Voverriding_terminal_local_map), data);
+      fn (KVAR (kb, Vlast_command), data);
+      fn (KVAR (kb, Vreal_last_command), data);
+      fn (KVAR (kb, Vkeyboard_translate_table), data);
+      fn (KVAR (kb, Vlast_repeatable_command), data);
+      fn (KVAR (kb, Vprefix_arg), data);
+      fn (KVAR (kb, Vlast_prefix_arg), data);
+      fn (KVAR (kb, kbd_queue), data);
+      fn (KVAR (kb, defining_kbd_macro), data);
+      fn (KVAR (kb, Vlast_kbd_macro), data);
+      fn (KVAR (kb, Vsystem_key_alist), data);
+      fn (KVAR (kb, system_key_syms), data);
+      fn (KVAR (kb, Vwindow_system), data);
+      fn (KVAR (kb, Vinput_decode_map), data);
+      fn (KVAR (kb, Vlocal_function_key_map), data);
+      fn (KVAR (kb, Vdefault_minibuffer_frame), data);
+      fn (KVAR (kb, echo_string), data);
+      fn (KVAR (kb, echo_prompt), data);
     }
   {
     union buffered_input_event *event;
@@ -11728,11 +11728,25 @@ mark_kboards (void)
 	if (event->kind != SELECTION_REQUEST_EVENT
 	    && event->kind != SELECTION_CLEAR_EVENT)
 	  {
-	    mark_object (event->ie.x);
-	    mark_object (event->ie.y);
-	    mark_object (event->ie.frame_or_window);
-	    mark_object (event->ie.arg);
+	    fn (event->ie.x, data);
+	    fn (event->ie.y, data);
+	    fn (event->ie.frame_or_window, data);
+	    fn (event->ie.arg, data);
 	  }
       }
   }
 }
+
+static void
+mark_kboard_root (Lisp_Object obj, void *data)
+{
+  mark_object (obj);
+}
+
+/* Mark the pointers in the kboard objects.
+   Called by Fgarbage_collect.  */
+void
+mark_kboards (void)
+{
+  map_kboard_roots (mark_kboard_root, NULL);
+}
@@ -491,6 +491,7 @@ extern bool volatile pending_signals;
 extern void process_pending_signals (void);
 extern struct timespec timer_check (void);
 extern void mark_kboards (void);
+extern void map_kboard_roots (void (*) (Lisp_Object, void *), void *);
 
 #ifdef HAVE_NTGUI
 extern const char *const lispy_function_keys[];
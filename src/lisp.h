@@ -969,6 +969,7 @@ enum pvec_type
   PVEC_MUTEX,
   PVEC_CONDVAR,
   PVEC_MODULE_FUNCTION,
+  PVEC_BUFFER_SNAPSHOT,
 
   /* These should be last, check internal_equal to see why.  */
   PVEC_COMPILED,
@@ -3623,6 +3624,14 @@ extern void adjust_after_insert (ptrdiff_t, ptrdiff_t, ptrdiff_t,
 				 ptrdiff_t, ptrdiff_t);
 extern void adjust_markers_for_delete (ptrdiff_t, ptrdiff_t,
 				       ptrdiff_t, ptrdiff_t);
+extern void truncate_charpos_index (struct buffer *, ptrdiff_t);
+extern bool charpos_index_lookup (struct buffer *, bool, ptrdiff_t,
+				  ptrdiff_t, ptrdiff_t,
+				  ptrdiff_t *, ptrdiff_t *,
+				  ptrdiff_t *, ptrdiff_t *);
+extern ptrdiff_t buf_newlines_before (struct buffer *, ptrdiff_t);
+extern bool line_index_skip (struct buffer *, ptrdiff_t, ptrdiff_t *,
+			     ptrdiff_t *, ptrdiff_t *);
 extern void adjust_markers_bytepos (ptrdiff_t, ptrdiff_t,
 				    ptrdiff_t, ptrdiff_t, int);
 extern void replace_range (ptrdiff_t, ptrdiff_t, Lisp_Object, bool, bool, bool, bool);
@@ -3710,6 +3719,7 @@ extern Lisp_Object list5 (Lisp_Object, Lisp_Object, Lisp_Object, Lisp_Object,
 			  Lisp_Object);
 enum constype {CONSTYPE_HEAP, CONSTYPE_PURE};
 extern Lisp_Object listn (enum constype, ptrdiff_t, Lisp_Object, ...);
+extern Lisp_Object cons_list (ptrdiff_t, Lisp_Object const *, Lisp_Object);
 extern Lisp_Object build_marker (struct buffer *, ptrdiff_t, ptrdiff_t);
 extern Lisp_Object bounded_number(EMACS_INT);
 
@@ -4043,6 +4053,8 @@ extern void syms_of_eval (void);
 extern void prog_ignore (Lisp_Object);
 extern ptrdiff_t record_in_backtrace (Lisp_Object, Lisp_Object *, ptrdiff_t);
 extern void mark_specpdl (union specbinding *first, union specbinding *ptr);
+extern void map_specpdl (union specbinding *, union specbinding *,
+			 void (*) (Lisp_Object, void *), void *);
 extern void get_backtrace (Lisp_Object array);
 Lisp_Object backtrace_top_function (void);
 extern bool let_shadows_buffer_binding_p (struct Lisp_Symbol *symbol);
@@ -4108,6 +4120,7 @@ extern void syms_of_module (void);
 
 /* Defined in thread.c.  */
 extern void mark_threads (void);
+extern void map_thread_roots (void (*) (Lisp_Object, void *), void *);
 
 /* Defined in editfns.c.  */
 extern Lisp_Object styled_format (ptrdiff_t, Lisp_Object *, bool);
@@ -4178,6 +4191,8 @@ extern void syms_of_fileio (void);
 
 /* Defined in search.c.  */
 extern void shrink_regexp_cache (void);
+extern void mark_regexp_cache (void);
+extern void map_regexp_cache_roots (void (*) (Lisp_Object, void *), void *);
 extern void restore_search_regs (void);
 extern void update_search_regs (ptrdiff_t oldstart,
                                 ptrdiff_t oldend, ptrdiff_t newend);
@@ -4205,6 +4220,11 @@ extern ptrdiff_t fast_c_string_match_ignore_case (Lisp_Object, const char *,
 						  ptrdiff_t);
 extern ptrdiff_t fast_looking_at (Lisp_Object, ptrdiff_t, ptrdiff_t,
                                   ptrdiff_t, ptrdiff_t, Lisp_Object);
+extern ptrdiff_t count_newlines (unsigned char const *, ptrdiff_t);
+extern ptrdiff_t skip_newline_blocks (unsigned char const *, ptrdiff_t,
+				      ptrdiff_t *);
+extern ptrdiff_t skip_newline_blocks_backward (unsigned char const *,
+					       ptrdiff_t, ptrdiff_t *);
 extern ptrdiff_t find_newline (ptrdiff_t, ptrdiff_t, ptrdiff_t, ptrdiff_t,
 			       ptrdiff_t, ptrdiff_t *, ptrdiff_t *, bool);
 extern ptrdiff_t scan_newline (ptrdiff_t, ptrdiff_t, ptrdiff_t, ptrdiff_t,
@@ -1527,6 +1527,19 @@ print_vectorlike (Lisp_Object obj, Lisp_Object printcharfun, bool escapeflag,
       print_c_string ("#<window-configuration>", printcharfun);
       break;
 
+    case PVEC_BUFFER_SNAPSHOT:
+      {
+	struct buffer *b = XBUFFER (XBUFFER_SNAPSHOT (obj)->buffer);
+
+	print_c_string ("#<buffer-snapshot ", printcharfun);
+	if (BUFFER_LIVE_P (b))
+	  print_string (BVAR (b, name), printcharfun);
+	else
+	  print_c_string ("of a killed buffer", printcharfun);
+	printchar ('>', printcharfun);
+      }
+      break;
+
     case PVEC_FRAME:
       {
 	void *ptr = XFRAME (obj);
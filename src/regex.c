@@ -529,6 +529,10 @@ static regoff_t re_match_2_internal (struct re_pattern_buffer *bufp,
 				     ssize_t pos,
 				     struct re_registers *regs,
 				     ssize_t stop);
+static int dfa_search (struct re_pattern_buffer *bufp,
+		       re_char *string1, size_t size1,
+		       re_char *string2, size_t size2,
+		       ssize_t first, ssize_t last, ssize_t stop);
 
 /* These are the command codes that appear in compiled regular
    expressions.  Some opcodes are followed by argument bytes.  A
@@ -4187,6 +4191,88 @@ WEAK_ALIAS (__re_search, re_search)
 #define POS_ADDR_VSTRING(POS)					\
   (((POS) >= size1 ? string2 - size1 : string1) + (POS))
 
+/* If every match of the pattern in BUFP begins with the same bytes,
+   return their address in the compiled pattern and store their number
+   in *LEN.  Otherwise return NULL.  The zero-width assertions that
+   search patterns commonly start with, like `^' and `\\_<', are looked
+   past, since they do not move the start of the match.  */
+
+static re_char *
+literal_prefix (struct re_pattern_buffer *bufp, int *len)
+{
+  re_char *p = bufp->buffer, *pend = p + bufp->used;
+
+  while (p < pend)
+    switch (*p)
+      {
+      case no_op: case begline: case wordbeg: case wordbound:
+      case notwordbound: case symbeg:
+	p++;
+	break;
+
+      case start_memory:
+	p += 2;
+	break;
+
+      case exactn:
+	if (p + 1 < pend && p[1] > 0)
+	  {
+	    *len = p[1];
+	    return p + 2;
+	  }
+	return NULL;
+
+      default:
+	return NULL;
+      }
+  return NULL;
+}
+
+/* Return the least position from START to LAST, in the virtual
+   concatenation of STRING1 and STRING2, at which the LEN bytes at LIT
+   occur completely before position STOP, or -1 if there is none.  */
+
+static ssize_t
+find_literal (re_char *lit, int len,
+	      re_char *string1, size_t size1, re_char *string2, size_t size2,
+	      ssize_t start, ssize_t last, ssize_t stop)
+{
+  ssize_t end = min ((ssize_t) (size1 + size2), stop);
+
+  last = min (last, end - len);
+
+  while (start <= last)
+    {
+      re_char *d = POS_ADDR_VSTRING (start);
+      ssize_t seg_end = start < size1 ? size1 : size1 + size2;
+      re_char *p = memchr (d, lit[0], min (last + 1, seg_end) - start);
+      ssize_t pos, i;
+
+      if (!p)
+	{
+	  start = seg_end;
+	  continue;
+	}
+      pos = start + (p - d);
+      if (pos + len <= seg_end)
+	{
+	  if (memcmp (p + 1, lit + 1, len - 1) == 0)
+	    return pos;
+	}
+      else
+	{
+	  /* The bytes straddle the end of STRING1.  */
+	  for (i = 1; i < len; i++)
+	    if (*POS_ADDR_VSTRING (pos + i) != lit[i])
+	      break;
+	  if (i == len)
+	    return pos;
+	}
+      start = pos + 1;
+    }
+  return -1;
+}
+
 /* Using the compiled pattern in BUFP->buffer, first tries to match the
    virtual concatenation of STRING1 and STRING2, starting first at index
    STARTPOS, then at STARTPOS + 1, and so on.
@@ -4223,6 +4309,11 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
   boolean anchored_start;
   /* Nonzero if we are searching multibyte string.  */
   const boolean multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+  /* The bytes every match starts with, if known.  */
+  re_char *literal = NULL;
+  int literal_len = 0;
+  /* Whether to ask the DFA before trying a starting point.  */
+  bool use_dfa;
 
   /* Check for out-of-range STARTPOS.  */
   if (startpos < 0 || startpos > total_size)
@@ -4264,6 +4355,23 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
   /* See whether the pattern is anchored.  */
   anchored_start = (bufp->buffer[0] == begline);
 
+  /* In a forward search without translation, the bytes every match
+     starts with can be looked for directly, which is much faster than
+     trying each position the fastmap lets through.  The pattern's
+     bytes are only the text's bytes if both have the same
+     multibyteness, or if they are ASCII.  */
+  if (range > 0 && !RE_TRANSLATE_P (translate))
+    {
+      literal = literal_prefix (bufp, &literal_len);
+      if (literal && RE_MULTIBYTE_P (bufp) != multibyte)
+	for (int i = 0; i < literal_len; i++)
+	  if (! IS_REAL_ASCII (literal[i]))
+	    {
+	      literal = NULL;
+	      break;
+	    }
+    }
+
 #ifdef emacs
   gl_state.object = re_match_object; /* Used by SYNTAX_TABLE_BYTE_TO_CHAR. */
   {
@@ -4273,9 +4381,40 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
   }
 #endif
 
+  /* When neither the literal prefix nor the fastmap can skip over
+     places where no match starts, let the DFA look at the whole range
+     of a forward search in one pass first: if no match starts anywhere
+     in it, no starting point need be tried.  (A backward search would
+     have the DFA scan from the far end of the range.)  */
+  use_dfa = (bufp->dfa && !bufp->not_bol && !bufp->not_eol
+	     && startpos + max (range, 0) <= stop && stop <= total_size);
+  if (use_dfa && range > 0 && !literal && (!fastmap || bufp->can_be_null))
+    switch (dfa_search (bufp, string1, size1, string2, size2,
+			startpos, startpos + range, stop))
+      {
+      case 0:
+	return -1;
+      case -1:
+	use_dfa = false;
+	break;
+      }
+
   /* Loop through the string, looking for a place to start matching.  */
   for (;;)
     {
+      /* Skip to the next place where the pattern's literal prefix
+	 occurs.  No match can start before it.  */
+      if (literal && range > 0)
+	{
+	  ssize_t pos = find_literal (literal, literal_len,
+				      string1, size1, string2, size2,
+				      startpos, startpos + range, stop);
+	  if (pos < 0)
+	    return -1;
+	  range -= pos - startpos;
+	  startpos = pos;
+	}
+
       /* If the pattern is anchored,
 	 skip quickly past places we cannot match.
 	 We don't bother to treat startpos == 0 specially
@@ -4292,7 +4431,7 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
 	 cannot be the start of a match.  If the pattern can match the
 	 null string, however, we don't need to skip characters; we want
 	 the first null string.  */
-      if (fastmap && startpos < total_size && !bufp->can_be_null)
+      if (!literal && fastmap && startpos < total_size && !bufp->can_be_null)
 	{
 	  register re_char *d;
 	  register re_wchar_t buf_ch;
@@ -4392,6 +4531,24 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
 	  && !bufp->can_be_null)
 	return -1;
 
+      /* Before backtracking from STARTPOS, have the DFA check that a
+	 match starts there.  If the caller does not want the groups,
+	 that is all there is to know.  */
+      if (use_dfa)
+	switch (dfa_search (bufp, string1, size1, string2, size2,
+			    startpos, startpos, stop))
+	  {
+	  case 0:
+	    goto advance;
+	  case 1:
+	    if (!regs)
+	      return startpos;
+	    break;
+	  default:
+	    use_dfa = false;
+	    break;
+	  }
+
       val = re_match_2_internal (bufp, string1, size1, string2, size2,
 				 startpos, regs, stop);
 
@@ -4871,6 +5028,744 @@ mutually_exclusive_p (struct re_pattern_buffer *bufp, re_char *p1,
   return 0;
 }
 
+
+/* The DFA.  */
+
+/* Most patterns use neither backreferences nor counted repetitions.
+   Such a pattern is a plain regular expression, and whether it matches
+   at a given place can be decided in time linear in the length of the
+   text, however its repetitions nest, by following all the ways the
+   compiled pattern could go at once.  `re_compile_dfa' turns the
+   compiled pattern into a graph of nodes, one for each character to
+   match and each jump or assertion; a state of the DFA is a set of
+   nodes, and the states and the transitions between them are built as
+   the text requires and kept for the next search.  re_search_2 and
+   re_match_2 ask the DFA whether a match can start at a place before
+   trying it with the backtracking matcher, which is still needed to
+   find the extent of the match and of its groups.  */
+
+enum dfa_node_type
+{
+  /* These consume one character.  */
+  DN_CHAR, DN_ANY, DN_SET,
+  /* `$' and `\\'', which wait to see the character that follows.  */
+  DN_EOL, DN_EOT,
+  DN_MATCH,
+  /* These are followed without consuming anything.  */
+  DN_BOL, DN_BOT, DN_JUMP, DN_SPLIT
+};
+
+struct dfa_node
+{
+  unsigned char type;
+  /* The node that follows, and for DN_SPLIT the other node that does.  */
+  int next, alt;
+  /* For DN_CHAR, the character of the pattern as it is compared with
+     characters of a multibyte and of a unibyte text.  For DN_SET, the
+     offset of the charset in the compiled pattern.  */
+  int arg, arg_unibyte;
+};
+
+/* Flags of a DFA state, which are also the context passed to
+   dfa_closure.  DS_BOL and DS_BOT say whether `^' and `\\`' hold at
+   the state's position.  DS_UNANCHORED says whether a match may also
+   start at the position after it.  */
+#define DS_BOL 1
+#define DS_BOT 2
+#define DS_UNANCHORED 4
+#define DC_NEWLINE 8		/* A newline follows.  */
+#define DC_END 16		/* The text ends.  */
+
+/* A state accepts if the pattern has matched, if it would match were
+   the next character a newline, or if it would match at the end of the
+   text.  */
+#define DA_MATCH 1
+#define DA_NEWLINE 2
+#define DA_END 4
+
+struct dfa_state
+{
+  /* The nodes of the state, sorted.  Only nodes that consume a
+     character, DN_EOL, DN_EOT and DN_MATCH are kept.  */
+  int *nodes;
+  int nnodes;
+  unsigned char flags, accept;
+  /* Whether NODES has a DN_EOL or DN_EOT.  */
+  bool pending;
+  /* The state reached on each character below the DFA's LIMIT, or -1
+     if not known yet.  */
+  int *next;
+  /* The state with the same nodes but without DS_UNANCHORED, or -1.  */
+  int anchored;
+  /* The next state in the same hash bucket, or -1.  */
+  int chain;
+};
+
+/* How many states are kept before they are all thrown away, and how
+   often that may happen in one call of dfa_search before it gives up
+   and leaves the work to the backtracking matcher.  */
+#define DFA_MAX_STATES 128
+#define DFA_MAX_FLUSHES 16
+#define DFA_BUCKETS 256
+
+struct re_dfa
+{
+  struct dfa_node *node;
+  int nnodes;
+
+  /* Transitions are cached for characters below LIMIT.  Characters
+     that character classes can only tell apart by looking at the
+     syntax or case table are not, since those tables may change.  */
+  int limit;
+
+  /* Whether the cached transitions are for a multibyte text.  */
+  bool target_multibyte;
+
+  struct dfa_state state[DFA_MAX_STATES];
+  int nstates;
+  int bucket[DFA_BUCKETS];
+  /* The state at the start of a search, for each combination of
+     DS_BOL, DS_BOT and DS_UNANCHORED.  */
+  int initial[8];
+  int flushes;
+
+  /* Scratch space for dfa_closure and dfa_step.  */
+  int *set, nset;
+  int *seeds;
+  int *stack;
+  unsigned *mark, gen;
+};
+
+/* Throw away all states of DFA.  */
+
+static void
+dfa_flush (struct re_dfa *dfa)
+{
+  int i;
+
+  for (i = 0; i < dfa->nstates; i++)
+    {
+      free (dfa->state[i].nodes);
+      free (dfa->state[i].next);
+    }
+  dfa->nstates = 0;
+  for (i = 0; i < DFA_BUCKETS; i++)
+    dfa->bucket[i] = -1;
+  for (i = 0; i < 8; i++)
+    dfa->initial[i] = -1;
+  dfa->flushes++;
+}
+
+void
+re_free_dfa (struct re_pattern_buffer *bufp)
+{
+  struct re_dfa *dfa = bufp->dfa;
+
+  if (!dfa)
+    return;
+  dfa_flush (dfa);
+  free (dfa->node);
+  free (dfa->set);
+  free (dfa->seeds);
+  free (dfa->stack);
+  free (dfa->mark);
+  free (dfa);
+  bufp->dfa = NULL;
+}
+
+void
+re_shrink_dfa (struct re_pattern_buffer *bufp)
+{
+  if (bufp->dfa)
+    dfa_flush (bufp->dfa);
+}
+
+void
+re_compile_dfa (struct re_pattern_buffer *bufp)
+{
+  re_char *pattern = bufp->buffer;
+  re_char *pend = pattern + bufp->used;
+  const boolean multibyte = RE_MULTIBYTE_P (bufp);
+  re_char *p;
+  int *node_of, n = 0, mcnt;
+  bool dynamic = false;
+  struct re_dfa *dfa;
+
+  re_free_dfa (bufp);
+  if (bufp->used == 0)
+    return;
+
+  node_of = malloc ((bufp->used + 1) * sizeof *node_of);
+  if (!node_of)
+    return;
+  memset (node_of, -1, (bufp->used + 1) * sizeof *node_of);
+
+  /* Number the nodes, and check that the pattern has only the opcodes
+     the DFA knows.  */
+  for (p = pattern; p < pend; )
+    {
+      node_of[p - pattern] = n;
+      switch (*p)
+	{
+	case exactn:
+	  {
+	    re_char *q = p + 2, *end = q + p[1];
+
+	    if (q == end)
+	      n++;
+	    for (; q < end; q += multibyte ? BYTES_BY_CHAR_HEAD (*q) : 1)
+	      n++;
+	    p = end;
+	  }
+	  break;
+
+	case no_op: case succeed: case anychar:
+	case begline: case endline: case begbuf: case endbuf:
+	  n++;
+	  p++;
+	  break;
+
+	case charset: case charset_not:
+	  if (CHARSET_RANGE_TABLE_EXISTS_P (p))
+	    {
+	      re_char *rtp = CHARSET_RANGE_TABLE (p);
+	      int count;
+
+#ifdef emacs
+	      if (CHARSET_RANGE_TABLE_BITS (p)
+		  & (BIT_WORD | BIT_LOWER | BIT_PUNCT | BIT_SPACE | BIT_UPPER))
+		dynamic = true;
+#endif
+	      EXTRACT_NUMBER_AND_INCR (count, rtp);
+	      p = CHARSET_RANGE_TABLE_END (rtp, count);
+	    }
+	  else
+	    p += 2 + CHARSET_BITMAP_SIZE (p);
+	  n++;
+	  break;
+
+	case start_memory: case stop_memory:
+	  n++;
+	  p += 2;
+	  break;
+
+	case jump: case on_failure_jump: case on_failure_keep_string_jump:
+	case on_failure_jump_loop: case on_failure_jump_nastyloop:
+	case on_failure_jump_smart:
+	  n++;
+	  p += 3;
+	  break;
+
+	default:
+	  /* Backreferences, counted repetitions and the assertions
+	     that look at the syntax table or at point.  */
+	  goto fail;
+	}
+    }
+  if (p != pend)
+    goto fail;
+  node_of[bufp->used] = n++;
+
+  dfa = calloc (1, sizeof *dfa);
+  if (!dfa)
+    goto fail;
+  bufp->dfa = dfa;
+  dfa->nnodes = n;
+  dfa->limit = dynamic ? 0x80 : 0x100;
+  dfa->node = malloc (n * sizeof *dfa->node);
+  dfa->set = malloc (n * sizeof *dfa->set);
+  dfa->seeds = malloc ((n + 1) * sizeof *dfa->seeds);
+  dfa->stack = malloc ((3 * n + 2) * sizeof *dfa->stack);
+  dfa->mark = calloc (n, sizeof *dfa->mark);
+  if (!dfa->node || !dfa->set || !dfa->seeds || !dfa->stack || !dfa->mark)
+    goto fail;
+  dfa_flush (dfa);
+
+  /* Fill in the nodes.  Nodes are numbered in the order of the
+     pattern, so the one that follows a node is the next one.  */
+  n = 0;
+  for (p = pattern; p < pend; )
+    {
+      struct dfa_node *node = &dfa->node[n];
+
+      node->next = n + 1;
+      switch (*p++)
+	{
+	case exactn:
+	  {
+	    re_char *end = p + 1 + *p;
+
+	    if (++p == end)
+	      dfa->node[n++].type = DN_JUMP;
+	    while (p < end)
+	      {
+		int pat_charlen, pat_ch;
+
+		node = &dfa->node[n];
+		node->type = DN_CHAR;
+		node->next = ++n;
+		if (multibyte)
+		  {
+		    pat_ch = STRING_CHAR_AND_LENGTH (p, pat_charlen);
+		    node->arg = pat_ch;
+		    node->arg_unibyte = RE_CHAR_TO_UNIBYTE (pat_ch);
+		  }
+		else
+		  {
+		    pat_charlen = 1;
+		    node->arg = RE_CHAR_TO_MULTIBYTE (*p);
+		    node->arg_unibyte = *p;
+		  }
+		p += pat_charlen;
+	      }
+	  }
+	  continue;
+
+	case no_op:
+	  node->type = DN_JUMP;
+	  break;
+
+	case succeed:
+	  node->type = DN_MATCH;
+	  break;
+
+	case anychar:
+	  node->type = DN_ANY;
+	  break;
+
+	case begline:
+	  node->type = DN_BOL;
+	  break;
+
+	case endline:
+	  node->type = DN_EOL;
+	  break;
+
+	case begbuf:
+	  node->type = DN_BOT;
+	  break;
+
+	case endbuf:
+	  node->type = DN_EOT;
+	  break;
+
+	case charset: case charset_not:
+	  node->type = DN_SET;
+	  node->arg = --p - pattern;
+	  if (CHARSET_RANGE_TABLE_EXISTS_P (p))
+	    {
+	      re_char *rtp = CHARSET_RANGE_TABLE (p);
+	      int count;
+
+	      EXTRACT_NUMBER_AND_INCR (count, rtp);
+	      p = CHARSET_RANGE_TABLE_END (rtp, count);
+	    }
+	  else
+	    p += 2 + CHARSET_BITMAP_SIZE (p);
+	  break;
+
+	case start_memory: case stop_memory:
+	  node->type = DN_JUMP;
+	  p++;
+	  break;
+
+	default:		/* A jump.  */
+	  node->type = p[-1] == jump ? DN_JUMP : DN_SPLIT;
+	  EXTRACT_NUMBER_AND_INCR (mcnt, p);
+	  if (p + mcnt < pattern || p + mcnt > pend
+	      || node_of[p + mcnt - pattern] < 0)
+	    goto fail;
+	  if (node->type == DN_JUMP)
+	    node->next = node_of[p + mcnt - pattern];
+	  else
+	    node->alt = node_of[p + mcnt - pattern];
+	  break;
+	}
+      n++;
+    }
+  dfa->node[n].type = DN_MATCH;
+  free (node_of);
+  return;
+
+ fail:
+  free (node_of);
+  re_free_dfa (bufp);
+}
+
+/* Set DFA->set to the nodes that the N nodes at SEEDS lead to without
+   consuming a character, given the assertions that CTX says hold.
+   Return whether a DN_MATCH node is among them.  */
+
+static bool
+dfa_closure (struct re_dfa *dfa, const int *seeds, int n, unsigned ctx)
+{
+  int *stack = dfa->stack, sp = 0;
+  bool match = false;
+
+  if (++dfa->gen == 0)
+    {
+      memset (dfa->mark, 0, dfa->nnodes * sizeof *dfa->mark);
+      dfa->gen = 1;
+    }
+  dfa->nset = 0;
+  while (n > 0)
+    stack[sp++] = seeds[--n];
+
+  while (sp > 0)
+    {
+      int i = stack[--sp];
+      struct dfa_node *node = &dfa->node[i];
+
+      if (dfa->mark[i] == dfa->gen)
+	continue;
+      dfa->mark[i] = dfa->gen;
+      switch (node->type)
+	{
+	case DN_JUMP:
+	  stack[sp++] = node->next;
+	  break;
+	case DN_SPLIT:
+	  stack[sp++] = node->alt;
+	  stack[sp++] = node->next;
+	  break;
+	case DN_BOL:
+	  if (ctx & DS_BOL)
+	    stack[sp++] = node->next;
+	  break;
+	case DN_BOT:
+	  if (ctx & DS_BOT)
+	    stack[sp++] = node->next;
+	  break;
+	case DN_EOL:
+	  if (ctx & (DC_NEWLINE | DC_END))
+	    stack[sp++] = node->next;
+	  else
+	    dfa->set[dfa->nset++] = i;
+	  break;
+	case DN_EOT:
+	  if (ctx & DC_END)
+	    stack[sp++] = node->next;
+	  else
+	    dfa->set[dfa->nset++] = i;
+	  break;
+	case DN_MATCH:
+	  match = true;
+	  FALLTHROUGH;
+	default:
+	  dfa->set[dfa->nset++] = i;
+	}
+    }
+  return match;
+}
+
+static int
+compare_ints (const void *a, const void *b)
+{
+  int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+}
+
+/* Return the state whose nodes are those in DFA->set and whose flags
+   are FLAGS, making it if need be.  Return -1 if out of memory.  */
+
+static int
+dfa_intern (struct re_dfa *dfa, unsigned flags)
+{
+  struct dfa_state *st;
+  unsigned hash = flags;
+  int i, j, b;
+
+  qsort (dfa->set, dfa->nset, sizeof *dfa->set, compare_ints);
+  for (i = 0; i < dfa->nset; i++)
+    hash = hash * 31 + dfa->set[i];
+  b = hash % DFA_BUCKETS;
+  for (i = dfa->bucket[b]; i >= 0; i = st->chain)
+    {
+      st = &dfa->state[i];
+      if (st->flags == flags && st->nnodes == dfa->nset
+	  && memcmp (st->nodes, dfa->set, dfa->nset * sizeof *dfa->set) == 0)
+	return i;
+    }
+
+  if (dfa->nstates == DFA_MAX_STATES)
+    dfa_flush (dfa);
+  i = dfa->nstates;
+  st = &dfa->state[i];
+  st->nodes = malloc (max (dfa->nset, 1) * sizeof *st->nodes);
+  st->next = malloc (dfa->limit * sizeof *st->next);
+  if (!st->nodes || !st->next)
+    {
+      free (st->nodes);
+      free (st->next);
+      return -1;
+    }
+  dfa->nstates++;
+  memcpy (st->nodes, dfa->set, dfa->nset * sizeof *dfa->set);
+  st->nnodes = dfa->nset;
+  memset (st->next, -1, dfa->limit * sizeof *st->next);
+  st->flags = flags;
+  st->anchored = -1;
+  st->chain = dfa->bucket[b];
+  dfa->bucket[b] = i;
+
+  st->accept = 0;
+  st->pending = false;
+  for (j = 0; j < st->nnodes; j++)
+    switch (dfa->node[st->nodes[j]].type)
+      {
+      case DN_MATCH:
+	st->accept |= DA_MATCH;
+	break;
+      case DN_EOL: case DN_EOT:
+	st->pending = true;
+	break;
+      }
+  if (st->pending)
+    {
+      unsigned ctx = flags & ~DS_UNANCHORED;
+
+      if (dfa_closure (dfa, st->nodes, st->nnodes, ctx | DC_NEWLINE))
+	st->accept |= DA_NEWLINE;
+      if (dfa_closure (dfa, st->nodes, st->nnodes, ctx | DC_END))
+	st->accept |= DA_END;
+    }
+  return i;
+}
+
+/* Return whether C, a character of the text as the backtracking
+   matcher decodes it, matches NODE of the DFA of BUFP.  */
+
+static bool
+dfa_char_matches (struct re_pattern_buffer *bufp, struct dfa_node *node,
+		  re_wchar_t c)
+{
+  RE_TRANSLATE_TYPE translate = bufp->translate;
+  const boolean target_multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+
+  switch (node->type)
+    {
+    case DN_CHAR:
+#ifdef emacs
+      if (!target_multibyte)
+	{
+	  re_wchar_t buf_ch = RE_CHAR_TO_MULTIBYTE (c);
+
+	  if (! CHAR_BYTE8_P (buf_ch))
+	    {
+	      buf_ch = TRANSLATE (buf_ch);
+	      buf_ch = RE_CHAR_TO_UNIBYTE (buf_ch);
+	      if (buf_ch < 0)
+		buf_ch = c;
+	    }
+	  else
+	    buf_ch = c;
+	  return buf_ch == node->arg_unibyte;
+	}
+#endif
+      return TRANSLATE (c) == node->arg;
+
+    case DN_ANY:
+      {
+	reg_syntax_t syntax;
+
+#ifdef emacs
+	syntax = RE_SYNTAX_EMACS;
+#else
+	syntax = bufp->syntax;
+#endif
+	c = TRANSLATE (c);
+	return !((!(syntax & RE_DOT_NEWLINE) && c == '\n')
+		 || ((syntax & RE_DOT_NOT_NULL) && c == '\000'));
+      }
+
+    case DN_SET:
+      {
+	re_char *p = bufp->buffer + node->arg;
+	unsigned int corig = c;
+	boolean unibyte_char = false;
+
+	if (target_multibyte)
+	  {
+	    int c1;
+
+	    c = TRANSLATE (c);
+	    c1 = RE_CHAR_TO_UNIBYTE (c);
+	    if (c1 >= 0)
+	      {
+		unibyte_char = true;
+		c = c1;
+	      }
+	  }
+	else
+	  {
+	    int c1 = RE_CHAR_TO_MULTIBYTE (c);
+
+	    if (! CHAR_BYTE8_P (c1))
+	      {
+		c1 = TRANSLATE (c1);
+		c1 = RE_CHAR_TO_UNIBYTE (c1);
+		if (c1 >= 0)
+		  {
+		    unibyte_char = true;
+		    c = c1;
+		  }
+	      }
+	    else
+	      unibyte_char = true;
+	  }
+	return execute_charset (&p, c, corig, unibyte_char);
+      }
+
+    default:
+      return false;
+    }
+}
+
+/* Return the state the DFA of BUFP goes to from state S on reading C,
+   or -1 if out of memory.  */
+
+static int
+dfa_step (struct re_pattern_buffer *bufp, int s, re_wchar_t c)
+{
+  struct re_dfa *dfa = bufp->dfa;
+  struct dfa_state *st = &dfa->state[s];
+  const int *from = st->nodes;
+  int nfrom = st->nnodes, nseeds = 0, i, next;
+  unsigned flags = st->flags;
+  int flushes = dfa->flushes;
+
+  /* A newline lets the nodes waiting on `$' through.  */
+  if (c == '\n' && st->pending)
+    {
+      dfa_closure (dfa, from, nfrom, (flags & ~DS_UNANCHORED) | DC_NEWLINE);
+      from = dfa->set;
+      nfrom = dfa->nset;
+    }
+  for (i = 0; i < nfrom; i++)
+    {
+      struct dfa_node *node = &dfa->node[from[i]];
+
+      if (node->type <= DN_SET && dfa_char_matches (bufp, node, c))
+	dfa->seeds[nseeds++] = node->next;
+    }
+  if (flags & DS_UNANCHORED)
+    dfa->seeds[nseeds++] = 0;	/* The first node of the pattern.  */
+
+  flags = (flags & DS_UNANCHORED) | (c == '\n' ? DS_BOL : 0);
+  dfa_closure (dfa, dfa->seeds, nseeds, flags);
+  next = dfa_intern (dfa, flags);
+  if (next >= 0 && c < dfa->limit && dfa->flushes == flushes)
+    st->next[c] = next;
+  return next;
+}
+
+/* Return the state with the nodes of state S but without
+   DS_UNANCHORED, or -1 if out of memory.  */
+
+static int
+dfa_anchored (struct re_dfa *dfa, int s)
+{
+  struct dfa_state *st = &dfa->state[s];
+  int flushes = dfa->flushes, a;
+
+  if (!(st->flags & DS_UNANCHORED))
+    return s;
+  if (st->anchored >= 0)
+    return st->anchored;
+  memcpy (dfa->set, st->nodes, st->nnodes * sizeof *dfa->set);
+  dfa->nset = st->nnodes;
+  a = dfa_intern (dfa, st->flags & ~DS_UNANCHORED);
+  if (a >= 0 && dfa->flushes == flushes)
+    st->anchored = a;
+  return a;
+}
+
+/* Return 1 if the pattern of BUFP matches somewhere in the virtual
+   concatenation of STRING1 and STRING2 starting from FIRST to LAST and
+   ending by STOP, 0 if it does not, and -1 if the DFA gave up.  The
+   caller must check that BUFP has a DFA, that neither `not_bol' nor
+   `not_eol' is set, and that LAST is not after STOP.  */
+
+static int
+dfa_search (struct re_pattern_buffer *bufp,
+	    re_char *string1, size_t size1, re_char *string2, size_t size2,
+	    ssize_t first, ssize_t last, ssize_t stop)
+{
+  struct re_dfa *dfa = bufp->dfa;
+  const boolean target_multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+  ssize_t total_size = size1 + size2, pos = first;
+  int flushes = dfa->flushes, start = 0, s;
+  unsigned flags = 0;
+
+  if (dfa->target_multibyte != target_multibyte)
+    {
+      dfa_flush (dfa);
+      dfa->target_multibyte = target_multibyte;
+      flushes = dfa->flushes;
+    }
+
+  if (pos == 0)
+    flags |= DS_BOL | DS_BOT;
+  else if (*POS_ADDR_VSTRING (pos - 1) == '\n')
+    flags |= DS_BOL;
+  if (first < last)
+    flags |= DS_UNANCHORED;
+  s = dfa->initial[flags];
+  if (s < 0)
+    {
+      dfa_closure (dfa, &start, 1, flags);
+      s = dfa_intern (dfa, flags);
+      if (s >= 0)
+	dfa->initial[flags] = s;
+    }
+
+  while (s >= 0)
+    {
+      struct dfa_state *st = &dfa->state[s];
+      re_char *d;
+      re_wchar_t c;
+      int len;
+
+      if (st->accept)
+	{
+	  if (st->accept & DA_MATCH)
+	    return 1;
+	  if (pos < total_size
+	      ? (st->accept & DA_NEWLINE) && *POS_ADDR_VSTRING (pos) == '\n'
+	      : st->accept & DA_END)
+	    return 1;
+	}
+      if (pos >= stop || (st->nnodes == 0 && !(st->flags & DS_UNANCHORED)))
+	return 0;
+      if (dfa->flushes - flushes > DFA_MAX_FLUSHES)
+	return -1;
+
+      d = POS_ADDR_VSTRING (pos);
+      if (target_multibyte)
+	c = STRING_CHAR_AND_LENGTH (d, len);
+      else
+	c = *d, len = 1;
+
+      /* No match may start after LAST.  */
+      if (pos + len > last && (st->flags & DS_UNANCHORED))
+	{
+	  s = dfa_anchored (dfa, s);
+	  if (s < 0)
+	    break;
+	  st = &dfa->state[s];
+	}
+
+      if (c < dfa->limit && st->next[c] >= 0)
+	s = st->next[c];
+      else
+	s = dfa_step (bufp, s, c);
+      pos += len;
+      if (s >= 0 && pos >= last)
+	s = dfa_anchored (dfa, s);
+    }
+  return -1;
+}
+
 
 /* Matching routines.  */
 
@@ -4915,6 +5810,12 @@ re_match_2 (struct re_pattern_buffer *bufp, const char *string1,
   SETUP_SYNTAX_TABLE_FOR_OBJECT (re_match_object, charpos, 1);
 #endif
 
+  if (bufp->dfa && !bufp->not_bol && !bufp->not_eol
+      && 0 <= pos && pos <= stop && stop <= size1 + size2
+      && dfa_search (bufp, (re_char *) string1, size1,
+		     (re_char *) string2, size2, pos, pos, stop) == 0)
+    return -1;
+
   result = re_match_2_internal (bufp, (re_char *) string1, size1,
 				(re_char *) string2, size2,
 				pos, regs, stop);
@@ -6407,6 +7308,7 @@ regcomp (regex_t *_Restrict_ preg, const char *_Restrict_ pattern,
   preg->buffer = 0;
   preg->allocated = 0;
   preg->used = 0;
+  preg->dfa = NULL;
 
   /* Try to allocate space for the fastmap.  */
   preg->fastmap = malloc (1 << BYTEWIDTH);
@@ -6599,6 +7501,8 @@ regfree (regex_t *preg)
 
   free (preg->translate);
   preg->translate = NULL;
+
+  re_free_dfa (preg);
 }
 WEAK_ALIAS (__regfree, regfree)
 
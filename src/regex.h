@@ -419,6 +419,11 @@ struct re_pattern_buffer
      so the compiled pattern is only valid for the current syntax table.  */
   unsigned used_syntax : 1;
 
+  /* A DFA that `re_search_2' uses to rule out starting points in
+     linear time, or null if `re_compile_dfa' found the pattern
+     unsuitable or was not called.  */
+  struct re_dfa *dfa;
+
 #ifdef emacs
   /* If true, multi-byte form in the regexp pattern should be
      recognized as a multibyte character.  */
@@ -498,6 +503,18 @@ extern const char *re_compile_pattern (const char *__pattern, size_t __length,
 extern int re_compile_fastmap (struct re_pattern_buffer *__buffer);
 
 
+/* Prepare the DFA for the pattern compiled into BUFFER, if the pattern
+   has no backreferences, counted repetitions or syntax-dependent
+   assertions.  Release it with `re_free_dfa' before the pattern is
+   recompiled or freed.  */
+extern void re_compile_dfa (struct re_pattern_buffer *__buffer);
+extern void re_free_dfa (struct re_pattern_buffer *__buffer);
+
+/* Free the states the DFA of BUFFER has built so far.  Later searches
+   build them again as they need them.  */
+extern void re_shrink_dfa (struct re_pattern_buffer *__buffer);
+
+
 /* Search in the string STRING (with length LENGTH) for the pattern
    compiled into BUFFER.  Start searching at position START, for RANGE
    characters.  Return the starting position of the match, -1 for no
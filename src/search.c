@@ -29,16 +29,24 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #include "region-cache.h"
 #include "blockinput.h"
 #include "intervals.h"
+#include "systime.h"
 
 #include "regex.h"
 
-#define REGEXP_CACHE_SIZE 20
+/* The regexp cache never holds fewer compiled patterns than this,
+   whatever the value of `regexp-cache-size'.  */
+#define REGEXP_CACHE_MIN_SIZE 20
 
 /* If the regexp is non-nil, then the buffer contains the compiled form
    of that regexp, suitable for searching.  */
 struct regexp_cache
 {
-  struct regexp_cache *next;
+  /* Neighbors in the list of entries, most recently used first.  */
+  struct regexp_cache *next, *prev;
+  /* Next entry in the same hash bucket, and the hash of the regexp,
+     translate table and posix flag this entry was compiled for.  */
+  struct regexp_cache *hash_next;
+  EMACS_UINT hash;
   Lisp_Object regexp, f_whitespace_regexp;
   /* Syntax table for which the regexp applies.  We need this because
      of character classes.  If this is t, then the compiled pattern is valid
@@ -50,11 +58,21 @@ struct regexp_cache
   bool posix;
 };
 
-/* The instances of that struct.  */
-static struct regexp_cache searchbufs[REGEXP_CACHE_SIZE];
+/* The head and tail of the list of cache entries; the head is the most
+   recently used one, the tail the one to reuse next.  */
+static struct regexp_cache *searchbuf_head, *searchbuf_tail;
 
-/* The head of the linked list; points to the most recently used buffer.  */
-static struct regexp_cache *searchbuf_head;
+/* Number of entries allocated so far.  */
+static ptrdiff_t searchbuf_count;
+
+/* Hash index of the entries that hold a compiled regexp, with
+   SEARCHBUF_INDEX_SIZE buckets, a power of 2.  */
+static struct regexp_cache **searchbuf_index;
+static ptrdiff_t searchbuf_index_size;
+
+/* Counters reported by `regexp-cache-statistics'.  */
+static EMACS_INT regexp_cache_hits, regexp_cache_misses;
+static double regexp_compile_time;
 
 
 /* Every call to re_match, etc., must pass &search_regs as the regs
@@ -84,8 +102,8 @@ static struct regexp_cache *searchbuf_head;
 static void set_search_regs (ptrdiff_t, ptrdiff_t);
 static void save_search_regs (void);
 static EMACS_INT simple_search (EMACS_INT, unsigned char *, ptrdiff_t,
-				ptrdiff_t, Lisp_Object, ptrdiff_t, ptrdiff_t,
-                                ptrdiff_t, ptrdiff_t);
+				ptrdiff_t, Lisp_Object, Lisp_Object,
+				ptrdiff_t, ptrdiff_t, ptrdiff_t, ptrdiff_t);
 static EMACS_INT boyer_moore (EMACS_INT, unsigned char *, ptrdiff_t,
                               Lisp_Object, Lisp_Object, ptrdiff_t,
                               ptrdiff_t, int);
@@ -153,6 +171,7 @@ compile_pattern_1 (struct regexp_cache *cp, Lisp_Object pattern,
   whitespace_regexp = STRINGP (Vsearch_spaces_regexp) ?
     SSDATA (Vsearch_spaces_regexp) : NULL;
 
+  re_free_dfa (&cp->buf);
   val = (char *) re_compile_pattern (SSDATA (pattern), SBYTES (pattern),
 				     posix, whitespace_regexp, &cp->buf);
 
@@ -164,11 +183,16 @@ compile_pattern_1 (struct regexp_cache *cp, Lisp_Object pattern,
   if (val)
     xsignal1 (Qinvalid_regexp, build_string (val));
 
+  /* Searches for a pattern without backreferences first ask a DFA
+     where a match may start, and only backtrack from there.  */
+  re_compile_dfa (&cp->buf);
+
   cp->regexp = Fcopy_sequence (pattern);
 }
 
 /* Shrink each compiled regexp buffer in the cache
-   to the size actually used right now.
+   to the size actually used right now, and drop the DFA states
+   built for it.
    This is called from garbage collection.  */
 
 void
@@ -180,9 +204,95 @@ shrink_regexp_cache (void)
     {
       cp->buf.allocated = cp->buf.used;
       cp->buf.buffer = xrealloc (cp->buf.buffer, cp->buf.used);
+      re_shrink_dfa (&cp->buf);
+    }
+}
+
+/* Call FN on each Lisp object in the regexp cache, passing DATA
+   along.  */
+
+void
+map_regexp_cache_roots (void (*fn) (Lisp_Object, void *), void *data)
+{
+  struct regexp_cache *cp;
+
+  for (cp = searchbuf_head; cp != 0; cp = cp->next)
+    {
+      fn (cp->regexp, data);
+      fn (cp->f_whitespace_regexp, data);
+      fn (cp->syntax_table, data);
     }
 }
 
+static void
+mark_regexp_cache_root (Lisp_Object obj, void *data)
+{
+  mark_object (obj);
+}
+
+/* Mark the Lisp objects in the regexp cache.
+   This is called from garbage collection.  */
+
+void
+mark_regexp_cache (void)
+{
+  map_regexp_cache_roots (mark_regexp_cache_root, NULL);
+}
+
+/* Return the hash bucket for HASH.  */
+
+static struct regexp_cache **
+regexp_cache_bucket (EMACS_UINT hash)
+{
+  return &searchbuf_index[hash & (searchbuf_index_size - 1)];
+}
+
+/* Remove CP from the hash index, if it is there, and forget its
+   regexp.  */
+
+static void
+regexp_cache_unhash (struct regexp_cache *cp)
+{
+  if (!NILP (cp->regexp))
+    {
+      struct regexp_cache **cpp = regexp_cache_bucket (cp->hash);
+      while (*cpp != cp)
+	cpp = &(*cpp)->hash_next;
+      *cpp = cp->hash_next;
+      cp->regexp = Qnil;
+    }
+}
+
+/* Unlink CP from the list of entries.  */
+
+static void
+regexp_cache_unlink (struct regexp_cache *cp)
+{
+  if (cp->prev)
+    cp->prev->next = cp->next;
+  else
+    searchbuf_head = cp->next;
+  if (cp->next)
+    cp->next->prev = cp->prev;
+  else
+    searchbuf_tail = cp->prev;
+}
+
+/* Add CP at the end of the list of entries, so that it is the next
+   one to be reused.  */
+
+static void
+regexp_cache_append (struct regexp_cache *cp)
+{
+  cp->next = 0;
+  cp->prev = searchbuf_tail;
+  if (searchbuf_tail)
+    searchbuf_tail->next = cp;
+  else
+    searchbuf_head = cp;
+  searchbuf_tail = cp;
+}
+
 /* Clear the regexp cache w.r.t. a particular syntax table,
    because it was changed.
    There is no danger of memory leak here because re_compile_pattern
@@ -191,14 +301,98 @@ shrink_regexp_cache (void)
 void
 clear_regexp_cache (void)
 {
-  int i;
-
-  for (i = 0; i < REGEXP_CACHE_SIZE; ++i)
-    /* It's tempting to compare with the syntax-table we've actually changed,
-       but it's not sufficient because char-table inheritance means that
-       modifying one syntax-table can change others at the same time.  */
-    if (!EQ (searchbufs[i].syntax_table, Qt))
-      searchbufs[i].regexp = Qnil;
+  struct regexp_cache *cp, *next;
+
+  for (cp = searchbuf_head; cp != 0; cp = next)
+    {
+      next = cp->next;
+      /* It's tempting to compare with the syntax-table we've actually
+	 changed, but it's not sufficient because char-table inheritance
+	 means that modifying one syntax-table can change others at the
+	 same time.  */
+      if (!NILP (cp->regexp) && !EQ (cp->syntax_table, Qt))
+	{
+	  regexp_cache_unhash (cp);
+	  /* Reuse the entry before any that still hold a regexp.  */
+	  regexp_cache_unlink (cp);
+	  regexp_cache_append (cp);
+	}
+    }
+}
+
+/* Return the number of entries the cache may hold.  */
+
+static ptrdiff_t
+regexp_cache_capacity (void)
+{
+  return clip_to_bounds (REGEXP_CACHE_MIN_SIZE, regexp_cache_size, 1 << 20);
+}
+
+/* Make the cache hold at most `regexp-cache-size' entries, and size
+   the hash index to the entries it holds, with room for the one that
+   compile_pattern may add.  The index thus grows with the cache rather
+   than with `regexp-cache-size'.  */
+
+static void
+regexp_cache_resize (void)
+{
+  ptrdiff_t capacity = regexp_cache_capacity ();
+  ptrdiff_t index_size = 16;
+  struct regexp_cache *cp;
+
+  while (searchbuf_count > capacity)
+    {
+      cp = searchbuf_tail;
+      regexp_cache_unhash (cp);
+      regexp_cache_unlink (cp);
+      re_free_dfa (&cp->buf);
+      xfree (cp->buf.buffer);
+      xfree (cp);
+      searchbuf_count--;
+    }
+
+  while (index_size <= searchbuf_count)
+    index_size *= 2;
+  if (index_size == searchbuf_index_size)
+    return;
+
+  xfree (searchbuf_index);
+  searchbuf_index = xzalloc (index_size * sizeof *searchbuf_index);
+  searchbuf_index_size = index_size;
+  for (cp = searchbuf_head; cp != 0; cp = cp->next)
+    if (!NILP (cp->regexp))
+      {
+	struct regexp_cache **bucket = regexp_cache_bucket (cp->hash);
+	cp->hash_next = *bucket;
+	*bucket = cp;
+      }
+}
+
+/* Return a cache entry to compile a new regexp into: a new one if the
+   cache is not full yet, otherwise the least recently used one.  The
+   entry is no longer in the hash index.  */
+
+static struct regexp_cache *
+regexp_cache_victim (void)
+{
+  struct regexp_cache *cp;
+
+  if (searchbuf_count < regexp_cache_capacity ())
+    {
+      cp = xzalloc (sizeof *cp);
+      cp->buf.fastmap = cp->fastmap;
+      cp->regexp = Qnil;
+      cp->f_whitespace_regexp = Qnil;
+      cp->syntax_table = Qnil;
+      regexp_cache_append (cp);
+      searchbuf_count++;
+    }
+  else
+    {
+      cp = searchbuf_tail;
+      regexp_cache_unhash (cp);
+    }
+  return cp;
 }
 
 /* Compile a regexp if necessary, but first check to see if there's one in
@@ -216,46 +410,61 @@ struct re_pattern_buffer *
 compile_pattern (Lisp_Object pattern, struct re_registers *regp,
 		 Lisp_Object translate, bool posix, bool multibyte)
 {
-  struct regexp_cache *cp, **cpp;
-
-  for (cpp = &searchbuf_head; ; cpp = &cp->next)
-    {
-      cp = *cpp;
-      /* Entries are initialized to nil, and may be set to nil by
-	 compile_pattern_1 if the pattern isn't valid.  Don't apply
-	 string accessors in those cases.  However, compile_pattern_1
-	 is only applied to the cache entry we pick here to reuse.  So
-	 nil should never appear before a non-nil entry.  */
-      if (NILP (cp->regexp))
-	goto compile_it;
-      if (SCHARS (cp->regexp) == SCHARS (pattern)
-	  && STRING_MULTIBYTE (cp->regexp) == STRING_MULTIBYTE (pattern)
-	  && !NILP (Fstring_equal (cp->regexp, pattern))
-	  && EQ (cp->buf.translate, (! NILP (translate) ? translate : make_number (0)))
-	  && cp->posix == posix
-	  && (EQ (cp->syntax_table, Qt)
-	      || EQ (cp->syntax_table, BVAR (current_buffer, syntax_table)))
-	  && !NILP (Fequal (cp->f_whitespace_regexp, Vsearch_spaces_regexp))
-	  && cp->buf.charset_unibyte == charset_unibyte)
-	break;
-
-      /* If we're at the end of the cache, compile into the nil cell
-	 we found, or the last (least recently used) cell with a
-	 string value.  */
-      if (cp->next == 0)
-	{
-	compile_it:
-	  compile_pattern_1 (cp, pattern, translate, posix);
-	  break;
-	}
+  struct regexp_cache *cp;
+  Lisp_Object trt = ! NILP (translate) ? translate : make_number (0);
+  EMACS_UINT hash;
+
+  regexp_cache_resize ();
+
+  /* The syntax table, Vsearch_spaces_regexp and charset_unibyte are
+     not part of the hash; an entry compiled for a syntax table of t is
+     valid with any syntax table, and the other two rarely change.  */
+  hash = hash_string (SSDATA (pattern), SBYTES (pattern));
+  hash = sxhash_combine (hash, XHASH (trt));
+  hash = sxhash_combine (hash, posix << 1 | STRING_MULTIBYTE (pattern));
+
+  for (cp = *regexp_cache_bucket (hash); cp; cp = cp->hash_next)
+    if (cp->hash == hash
+	&& SCHARS (cp->regexp) == SCHARS (pattern)
+	&& STRING_MULTIBYTE (cp->regexp) == STRING_MULTIBYTE (pattern)
+	&& !NILP (Fstring_equal (cp->regexp, pattern))
+	&& EQ (cp->buf.translate, trt)
+	&& cp->posix == posix
+	&& (EQ (cp->syntax_table, Qt)
+	    || EQ (cp->syntax_table, BVAR (current_buffer, syntax_table)))
+	&& !NILP (Fequal (cp->f_whitespace_regexp, Vsearch_spaces_regexp))
+	&& cp->buf.charset_unibyte == charset_unibyte)
+      break;
+
+  if (cp)
+    regexp_cache_hits++;
+  else
+    {
+      struct timespec start = current_timespec ();
+      struct regexp_cache **bucket;
+
+      regexp_cache_misses++;
+      cp = regexp_cache_victim ();
+      compile_pattern_1 (cp, pattern, translate, posix);
+      regexp_compile_time
+	+= timespectod (timespec_sub (current_timespec (), start));
+      cp->hash = hash;
+      bucket = regexp_cache_bucket (hash);
+      cp->hash_next = *bucket;
+      *bucket = cp;
     }
 
-  /* When we get here, cp (aka *cpp) contains the compiled pattern,
-     either because we found it in the cache or because we just compiled it.
-     Move it to the front of the queue to mark it as most recently used.  */
-  *cpp = cp->next;
-  cp->next = searchbuf_head;
-  searchbuf_head = cp;
+  /* When we get here, cp contains the compiled pattern, either
+     because we found it in the cache or because we just compiled it.
+     Move it to the front of the list to mark it as most recently used.  */
+  if (cp != searchbuf_head)
+    {
+      regexp_cache_unlink (cp);
+      cp->prev = 0;
+      cp->next = searchbuf_head;
+      searchbuf_head->prev = cp;
+      searchbuf_head = cp;
+    }
 
   /* Advise the searching functions about the space we have allocated
      for register data.  */
@@ -269,6 +478,34 @@ compile_pattern (Lisp_Object pattern, struct re_registers *regp,
   return &cp->buf;
 }
 
+DEFUN ("regexp-cache-statistics", Fregexp_cache_statistics,
+       Sregexp_cache_statistics, 0, 0, 0,
+       doc: /* Return statistics about the cache of compiled regexps.
+The value is a property list with these properties:
+
+ `:size'          the number of regexps in the cache,
+ `:capacity'      how many regexps the cache can hold,
+ `:hits'          how often a search found its regexp in the cache,
+ `:misses'        how often a regexp had to be compiled,
+ `:compile-time'  the total time spent compiling them, in seconds.
+
+The counts are since Emacs started.  See also `regexp-cache-size'.  */)
+  (void)
+{
+  ptrdiff_t size = 0;
+  struct regexp_cache *cp;
+
+  for (cp = searchbuf_head; cp != 0; cp = cp->next)
+    if (!NILP (cp->regexp))
+      size++;
+  return listn (CONSTYPE_HEAP, 10,
+		QCsize, make_number (size),
+		QCcapacity, make_number (regexp_cache_capacity ()),
+		QChits, make_fixnum_or_float (regexp_cache_hits),
+		QCmisses, make_fixnum_or_float (regexp_cache_misses),
+		QCcompile_time, make_float (regexp_compile_time));
+}
+
 
 Lisp_Object
 looking_at_1 (Lisp_Object string, bool posix)
@@ -525,6 +762,75 @@ fast_looking_at (Lisp_Object regexp, ptrdiff_t pos, ptrdiff_t pos_byte,
   return len;
 }
 
+DEFUN ("buffer-snapshot-search", Fbuffer_snapshot_search,
+       Sbuffer_snapshot_search, 2, 3, 0,
+       doc: /* Search SNAPSHOT for the first match for REGEXP after START.
+SNAPSHOT is an object made by `buffer-snapshot'.  START is a position
+in it, as it was in the buffer when the snapshot was made, and defaults
+to the beginning of its text.
+
+Matching uses the syntax table of the current buffer and ignores case
+if `case-fold-search' is non-nil, as `string-match' does.  Text
+properties are not part of a snapshot, so `syntax-table' properties
+have no effect.
+
+If there is a match, return a list of positions like the one that
+`match-data' would return after a buffer search: the beginning and
+end of the whole match, then those of each subexpression, or nil for
+a subexpression that did not match.  Return nil if there is no match.
+This does not change the match data.  */)
+  (Lisp_Object regexp, Lisp_Object snapshot, Lisp_Object start)
+{
+  struct Lisp_Buffer_Snapshot *s;
+  struct re_pattern_buffer *bufp;
+  struct re_registers regs = { 0 };
+  ptrdiff_t from, to, from_byte, val, val_char, i;
+  Lisp_Object result = Qnil;
+
+  CHECK_STRING (regexp);
+  buffer_snapshot_range (snapshot, start, Qnil, &from, &to);
+  s = XBUFFER_SNAPSHOT (snapshot);
+  from_byte = buffer_snapshot_char_to_byte (s, from);
+
+  /* This is so set_image_of_range_1 in regex.c can find the EQV table.  */
+  set_char_table_extras (BVAR (current_buffer, case_canon_table), 2,
+			 BVAR (current_buffer, case_eqv_table));
+
+  bufp = compile_pattern (regexp, &regs,
+			  (!NILP (BVAR (current_buffer, case_fold_search))
+			   ? BVAR (current_buffer, case_canon_table) : Qnil),
+			  false, s->multibyte);
+  re_match_object = Qt;
+  val = re_search (bufp, (char *) s->text, s->nbytes, from_byte,
+		   s->nbytes - from_byte, &regs);
+  if (val == -2)
+    matcher_overflow ();
+  if (val < 0)
+    return Qnil;
+
+  /* Every register lies at or after the start of the match, so count
+     characters from there.  */
+  val_char = buffer_snapshot_byte_to_char (s, val);
+  for (i = regs.num_regs - 1; i >= 0; i--)
+    if (regs.start[i] >= 0)
+      {
+	ptrdiff_t b = regs.start[i] - val, e = regs.end[i] - val;
+	if (s->multibyte)
+	  {
+	    b = multibyte_chars_in_text (s->text + val, b);
+	    e = multibyte_chars_in_text (s->text + val, e);
+	  }
+	result = Fcons (make_number (s->beg + val_char + b),
+			Fcons (make_number (s->beg + val_char + e), result));
+      }
+    else if (!NILP (result))
+      result = Fcons (Qnil, Fcons (Qnil, result));
+
+  xfree (regs.start);
+  xfree (regs.end);
+  return result;
+}
+
 
 /* The newline cache: remembering which sections of text have no newlines.  */
 
@@ -576,6 +882,96 @@ newline_cache_on_off (struct buffer *buf)
     }
 }
 
+
+/* Counting newlines a block at a time.  */
+
+/* Return the number of newlines in the NBYTES bytes at P.  This looks
+   at a word at a time, which beats calling memchr for each line when
+   lines are short.  */
+
+ptrdiff_t
+count_newlines (unsigned char const *p, ptrdiff_t nbytes)
+{
+  uint64_t const ones = 0x0101010101010101, lows = 0x7f7f7f7f7f7f7f7f;
+  ptrdiff_t n = 0;
+
+  while (nbytes >= sizeof (uint64_t))
+    {
+      /* Each byte of ACC counts the newlines at that offset in the
+	 words seen so far, so it can take 255 words at most.  */
+      uint64_t acc = 0;
+      ptrdiff_t i, words = min (nbytes / sizeof (uint64_t), 255);
+
+      for (i = 0; i < words; i++, p += sizeof (uint64_t))
+	{
+	  uint64_t w;
+	  memcpy (&w, p, sizeof w);
+	  w ^= ones * '\n';
+	  /* Now a byte of W is zero where P had a newline; turn it into
+	     1 and every other byte into 0.  */
+	  acc += ~(((w & lows) + lows) | w | lows) >> 7;
+	}
+      nbytes -= words * sizeof (uint64_t);
+
+      acc = (acc & 0x00ff00ff00ff00ff) + ((acc >> 8) & 0x00ff00ff00ff00ff);
+      n += (acc * 0x0001000100010001) >> 48;
+    }
+  for (; 0 < nbytes; nbytes--)
+    n += *p++ == '\n';
+  return n;
+}
+
+/* Line scanners that look for the *COUNTth newline use these to skip
+   whole blocks that hold fewer than *COUNT newlines.  That only pays
+   when the newline is likely to be beyond the block, so nothing is
+   skipped when *COUNT is small.  */
+
+enum { NEWLINE_BLOCK_SIZE = 4096, NEWLINE_BLOCK_MIN_COUNT = 64 };
+
+/* Skip blocks at the start of the NBYTES bytes at P, which must have
+   fewer than *COUNT newlines, and decrease *COUNT by the number of
+   newlines in them.  Return the number of bytes skipped.  */
+
+ptrdiff_t
+skip_newline_blocks (unsigned char const *p, ptrdiff_t nbytes,
+		     ptrdiff_t *count)
+{
+  ptrdiff_t skipped = 0;
+
+  while (NEWLINE_BLOCK_MIN_COUNT < *count
+	 && NEWLINE_BLOCK_SIZE <= nbytes - skipped)
+    {
+      ptrdiff_t n = count_newlines (p + skipped, NEWLINE_BLOCK_SIZE);
+      if (*count <= n)
+	break;
+      *count -= n;
+      skipped += NEWLINE_BLOCK_SIZE;
+    }
+  return skipped;
+}
+
+/* Likewise, but skip blocks at the end of the NBYTES bytes before
+   LIM.  */
+
+ptrdiff_t
+skip_newline_blocks_backward (unsigned char const *lim, ptrdiff_t nbytes,
+			      ptrdiff_t *count)
+{
+  ptrdiff_t skipped = 0;
+
+  while (NEWLINE_BLOCK_MIN_COUNT < *count
+	 && NEWLINE_BLOCK_SIZE <= nbytes - skipped)
+    {
+      ptrdiff_t n = count_newlines (lim - skipped - NEWLINE_BLOCK_SIZE,
+				    NEWLINE_BLOCK_SIZE);
+      if (*count <= n)
+	break;
+      *count -= n;
+      skipped += NEWLINE_BLOCK_SIZE;
+    }
+  return skipped;
+}
+
 
 /* Search for COUNT newlines between START/START_BYTE and END/END_BYTE.
 
@@ -633,6 +1029,15 @@ find_newline (ptrdiff_t start, ptrdiff_t start_byte, ptrdiff_t end,
   if (shortage != 0)
     *shortage = 0;
 
+  /* Over long distances, let the line index skip the text that
+     cannot contain the newline we want.  */
+  if (count > 0 && end - start >= 2 * CHARPOS_INDEX_STRIDE)
+    {
+      if (start_byte == -1)
+	start_byte = CHAR_TO_BYTE (start);
+      line_index_skip (current_buffer, end_byte, &count, &start, &start_byte);
+    }
+
   if (count > 0)
     while (start != end)
       {
@@ -733,8 +1138,12 @@ find_newline (ptrdiff_t start, ptrdiff_t start_byte, ptrdiff_t end,
 
 	  for (cursor = base; cursor < 0; cursor = next)
 	    {
+	      unsigned char *nl;
+
+	      cursor += skip_newline_blocks (lim_addr + cursor, - cursor, &count);
+
               /* The dumb loop.  */
-	      unsigned char *nl = memchr (lim_addr + cursor, '\n', - cursor);
+	      nl = memchr (lim_addr + cursor, '\n', - cursor);
 	      next = nl ? nl - lim_addr : 0;
 
               /* If we're using the newline cache, cache the fact that
@@ -842,7 +1251,14 @@ find_newline (ptrdiff_t start, ptrdiff_t start_byte, ptrdiff_t end,
 
 	  for (cursor = base; 0 < cursor; cursor = prev)
             {
-	      unsigned char *nl = memrchr (ceiling_addr, '\n', cursor);
+	      unsigned char *nl;
+	      ptrdiff_t left = - count;
+
+	      cursor -= skip_newline_blocks_backward (ceiling_addr + cursor,
+						      cursor, &left);
+	      count = - left;
+
+	      nl = memrchr (ceiling_addr, '\n', cursor);
 	      prev = nl ? nl - ceiling_addr : -1;
 
               /* If we're looking for newlines, cache the fact that
@@ -1454,16 +1870,106 @@ search_buffer (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
 			  pos_byte, lim_byte,
 			  char_base)
 	   : simple_search (n, pat, raw_pattern_size, len_byte, trt,
-			    pos, pos_byte, lim, lim_byte));
+			    inverse_trt, pos, pos_byte, lim, lim_byte));
       SAFE_FREE ();
       return result;
     }
 }
 
+/* simple_search tries to match at every character, which is slow when
+   each try goes through TRT.  Searching forward in multibyte text, it
+   first skips to the next byte that can start the first character of
+   the pattern; there are few such bytes, since all case variants of a
+   character usually start with the same byte or two.  */
+
+enum { MAX_LEAD_BYTES = 4 };
+
+/* Store in LEADS the distinct first bytes of the characters that TRT
+   translates to the first character of PAT, using INVERSE_TRT to find
+   them, and return how many there are.  Return 0 if they cannot be
+   found or there are more than MAX_LEAD_BYTES of them.  */
+
+static int
+match_lead_bytes (unsigned char const *pat, Lisp_Object trt,
+		  Lisp_Object inverse_trt, unsigned char *leads)
+{
+  int c = STRING_CHAR (pat), ch = c, nleads = 0, i, steps = 0;
+
+  if (NILP (trt))
+    {
+      leads[0] = *pat;
+      return 1;
+    }
+  if (NILP (inverse_trt))
+    return 0;
+
+  /* INVERSE_TRT links the case variants of C in a cycle.  */
+  do
+    {
+      unsigned char str[MAX_MULTIBYTE_LENGTH];
+      CHAR_STRING (ch, str);
+      for (i = 0; i < nleads && leads[i] != str[0]; i++)
+	continue;
+      if (i == nleads)
+	{
+	  if (nleads == MAX_LEAD_BYTES)
+	    return 0;
+	  leads[nleads++] = str[0];
+	}
+      TRANSLATE (ch, inverse_trt, ch);
+    }
+  while (ch != c && ++steps < 16);
+
+  return ch == c ? nleads : 0;
+}
+
+/* Return the number of bytes at the start of the NBYTES bytes at P
+   that come before the first byte that is one of the NLEADS bytes in
+   LEADS, or NBYTES if there is none.  Set *NCHARS to the number of
+   characters in the bytes skipped.  This looks at a word at a time.  */
+
+static ptrdiff_t
+skip_to_lead_bytes (unsigned char const *p, ptrdiff_t nbytes,
+		    unsigned char const *leads, int nleads,
+		    ptrdiff_t *nchars)
+{
+  uint64_t const ones = 0x0101010101010101, lows = 0x7f7f7f7f7f7f7f7f;
+  ptrdiff_t i = 0, continuations = 0;
+  int j;
+
+  for (; i + (ptrdiff_t) sizeof (uint64_t) <= nbytes; i += sizeof (uint64_t))
+    {
+      uint64_t w, found = 0;
+      memcpy (&w, p + i, sizeof w);
+      for (j = 0; j < nleads; j++)
+	{
+	  uint64_t x = w ^ (ones * leads[j]);
+	  found |= ~(((x & lows) + lows) | x | lows);
+	}
+      if (found)
+	break;
+      /* A continuation byte has its top bits set to 10.  Sum the
+	 resulting 0 or 1 in each byte into the top byte.  */
+      continuations += ((((w & ~(w << 1)) >> 7) & ones) * ones) >> 56;
+    }
+
+  for (; i < nbytes; i++)
+    {
+      for (j = 0; j < nleads; j++)
+	if (p[i] == leads[j])
+	  goto done;
+      continuations += ! CHAR_HEAD_P (p[i]);
+    }
+
+ done:
+  *nchars = i - continuations;
+  return i;
+}
+
 /* Do a simple string search N times for the string PAT,
    whose length is LEN/LEN_BYTE,
    from buffer position POS/POS_BYTE until LIM/LIM_BYTE.
-   TRT is the translation table.
+   TRT is the translation table, and INVERSE_TRT its inverse.
 
    Return the character position where the match is found.
    Otherwise, if M matches remained to be found, return -M.
@@ -1474,7 +1980,8 @@ search_buffer (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
 
 static EMACS_INT
 simple_search (EMACS_INT n, unsigned char *pat,
-	       ptrdiff_t len, ptrdiff_t len_byte, Lisp_Object trt,
+	       ptrdiff_t len, ptrdiff_t len_byte,
+	       Lisp_Object trt, Lisp_Object inverse_trt,
 	       ptrdiff_t pos, ptrdiff_t pos_byte,
 	       ptrdiff_t lim, ptrdiff_t lim_byte)
 {
@@ -1483,17 +1990,38 @@ simple_search (EMACS_INT n, unsigned char *pat,
   /* Number of buffer bytes matched.  Note that this may be different
      from len_byte in a multibyte buffer.  */
   ptrdiff_t match_byte = PTRDIFF_MIN;
+  /* The bytes that can start a match, when searching forward in
+     multibyte text.  */
+  unsigned char leads[MAX_LEAD_BYTES];
+  int nleads = (lim > pos && multibyte
+		? match_lead_bytes (pat, trt, inverse_trt, leads) : 0);
 
   if (lim > pos && multibyte)
     while (n > 0)
       {
 	while (1)
 	  {
-	    /* Try matching at position POS.  */
-	    ptrdiff_t this_pos = pos;
-	    ptrdiff_t this_pos_byte = pos_byte;
-	    ptrdiff_t this_len = len;
+	    ptrdiff_t this_pos, this_pos_byte, this_len;
 	    unsigned char *p = pat;
+
+	    if (nleads > 0)
+	      {
+		/* Skip to where a match can start, stopping at the gap.  */
+		ptrdiff_t end_byte = (pos_byte < GPT_BYTE && GPT_BYTE < lim_byte
+				      ? GPT_BYTE : lim_byte);
+		ptrdiff_t nchars;
+		pos_byte += skip_to_lead_bytes (BYTE_POS_ADDR (pos_byte),
+						end_byte - pos_byte,
+						leads, nleads, &nchars);
+		pos += nchars;
+		if (pos_byte == end_byte && end_byte < lim_byte)
+		  continue;
+	      }
+
+	    /* Try matching at position POS.  */
+	    this_pos = pos;
+	    this_pos_byte = pos_byte;
+	    this_len = len;
 	    if (pos + len > lim || pos_byte + len_byte > lim_byte)
 	      goto stop;
 
@@ -2951,6 +3479,265 @@ DEFUN ("regexp-quote", Fregexp_quote, Sregexp_quote, 1, 1, 0,
   return result;
 }
 
+
+/* Multiple string search.
+
+   search-strings-in-region finds every occurrence of any of a set of
+   strings in one pass over the text, using the Aho-Corasick
+   automaton: a trie of the strings, where each node also has a
+   failure link to the node for the longest proper suffix of its path
+   that is also in the trie.  Node 0 is the root.  Trie edges are
+   kept in an open-addressed hash table keyed on the source node and
+   the character, so the automaton works directly on characters and
+   its size depends only on the total length of the strings.  */
+
+struct ac_edge
+{
+  ptrdiff_t from, to;
+  int c;
+};
+
+struct ac_automaton
+{
+  /* Per node: failure link, first string that ends at the node or -1,
+     and the nearest node on the failure chain that has a string ending
+     there, or 0 if none does.  */
+  ptrdiff_t *fail, *out, *dict;
+
+  /* Per node: first child and next sibling, for the breadth-first walk
+     that computes the failure links.  0 means none.  */
+  ptrdiff_t *child, *sibling;
+  int *in_char;
+
+  /* Per string: next string with the same contents, or -1, and its
+     length in characters.  */
+  ptrdiff_t *next_same, *nchars;
+
+  struct ac_edge *edges;
+  ptrdiff_t edge_mask;
+  ptrdiff_t nnodes;
+};
+
+static ptrdiff_t
+ac_edge_slot (struct ac_automaton *ac, ptrdiff_t from, int c)
+{
+  size_t h = ((size_t) from * 31 + c) * 0x9e3779b1u;
+  ptrdiff_t i = (h ^ (h >> 16)) & ac->edge_mask;
+  while (ac->edges[i].from >= 0
+	 && ! (ac->edges[i].from == from && ac->edges[i].c == c))
+    i = (i + 1) & ac->edge_mask;
+  return i;
+}
+
+/* Return the node reached from FROM on character C, or -1.  */
+
+static ptrdiff_t
+ac_goto (struct ac_automaton *ac, ptrdiff_t from, int c)
+{
+  struct ac_edge *e = &ac->edges[ac_edge_slot (ac, from, c)];
+  return e->from < 0 ? -1 : e->to;
+}
+
+/* Return the next state after reading C in state STATE.  */
+
+static ptrdiff_t
+ac_step (struct ac_automaton *ac, ptrdiff_t state, int c)
+{
+  for (;;)
+    {
+      ptrdiff_t next = ac_goto (ac, state, c);
+      if (next >= 0)
+	return next;
+      if (state == 0)
+	return 0;
+      state = ac->fail[state];
+    }
+}
+
+/* Build in AC the automaton for the strings in the vector STRINGS,
+   translating their characters through TRT unless it is nil.  Return
+   the memory block that holds the automaton, for the caller to free.  */
+
+static void *
+ac_build (struct ac_automaton *ac, Lisp_Object strings, Lisp_Object trt)
+{
+  ptrdiff_t nstrings = ASIZE (strings);
+  ptrdiff_t maxnodes = 1;
+
+  for (ptrdiff_t i = 0; i < nstrings; i++)
+    {
+      Lisp_Object string = AREF (strings, i);
+      CHECK_STRING (string);
+      if (INT_ADD_WRAPV (maxnodes, SCHARS (string), &maxnodes))
+	memory_full (SIZE_MAX);
+    }
+
+  ptrdiff_t nedges = 16;
+  while (nedges < maxnodes * 2)
+    if (INT_MULTIPLY_WRAPV (nedges, 2, &nedges))
+      memory_full (SIZE_MAX);
+
+  /* Allocate everything in one block, most strictly aligned first.  */
+  ptrdiff_t nbytes;
+  if (INT_MULTIPLY_WRAPV (maxnodes, 7 * sizeof (ptrdiff_t) + sizeof (int),
+			  &nbytes)
+      || INT_ADD_WRAPV (nbytes, nstrings * 2 * sizeof (ptrdiff_t), &nbytes)
+      || INT_ADD_WRAPV (nbytes, nedges * sizeof (struct ac_edge), &nbytes))
+    memory_full (SIZE_MAX);
+  void *block = xmalloc (nbytes);
+  ac->edges = block;
+  ac->fail = (ptrdiff_t *) (ac->edges + nedges);
+  ac->out = ac->fail + maxnodes;
+  ac->dict = ac->out + maxnodes;
+  ac->child = ac->dict + maxnodes;
+  ac->sibling = ac->child + maxnodes;
+  ptrdiff_t *queue = ac->sibling + maxnodes;
+  ac->next_same = queue + maxnodes;
+  ac->nchars = ac->next_same + nstrings;
+  ac->in_char = (int *) (ac->nchars + nstrings);
+
+  ac->edge_mask = nedges - 1;
+  for (ptrdiff_t i = 0; i < nedges; i++)
+    ac->edges[i].from = -1;
+
+  ac->nnodes = 1;
+  ac->fail[0] = ac->dict[0] = ac->child[0] = ac->sibling[0] = 0;
+  ac->out[0] = -1;
+
+  /* Insert the strings into the trie.  */
+  for (ptrdiff_t i = 0; i < nstrings; i++)
+    {
+      Lisp_Object string = AREF (strings, i);
+      ptrdiff_t charidx = 0, byteidx = 0, node = 0;
+
+      ac->next_same[i] = -1;
+      ac->nchars[i] = SCHARS (string);
+
+      /* An empty string never matches.  */
+      if (SCHARS (string) == 0)
+	continue;
+
+      while (charidx < SCHARS (string))
+	{
+	  int c;
+	  FETCH_STRING_CHAR_AS_MULTIBYTE_ADVANCE (c, string, charidx, byteidx);
+	  if (!NILP (trt))
+	    c = char_table_translate (trt, c);
+	  struct ac_edge *e = &ac->edges[ac_edge_slot (ac, node, c)];
+	  if (e->from < 0)
+	    {
+	      ptrdiff_t new = ac->nnodes++;
+	      e->from = node;
+	      e->c = c;
+	      e->to = new;
+	      ac->out[new] = -1;
+	      ac->child[new] = 0;
+	      ac->in_char[new] = c;
+	      ac->sibling[new] = ac->child[node];
+	      ac->child[node] = new;
+	    }
+	  node = e->to;
+	}
+
+      /* Keep strings with the same contents in ascending order.  */
+      ptrdiff_t *tail = &ac->out[node];
+      while (*tail >= 0)
+	tail = &ac->next_same[*tail];
+      *tail = i;
+    }
+
+  /* Compute the failure and output links breadth-first, so that the
+     links of every shallower node are known when they are needed.  */
+  ptrdiff_t head = 0, tail = 0;
+  queue[tail++] = 0;
+  while (head < tail)
+    {
+      ptrdiff_t node = queue[head++];
+      for (ptrdiff_t n = ac->child[node]; n; n = ac->sibling[n])
+	{
+	  ptrdiff_t f = (node == 0 ? 0
+			 : ac_step (ac, ac->fail[node], ac->in_char[n]));
+	  ac->fail[n] = f;
+	  ac->dict[n] = ac->out[f] >= 0 ? f : ac->dict[f];
+	  queue[tail++] = n;
+	}
+    }
+
+  return block;
+}
+
+DEFUN ("search-strings-in-region", Fsearch_strings_in_region,
+       Ssearch_strings_in_region, 1, 3, 0,
+       doc: /* Find all occurrences of STRINGS between START and END.
+STRINGS is a list or vector of strings.  START and END default to the
+beginning and end of the accessible portion of the buffer.
+
+Return a list of elements (INDEX BEG END), one for each occurrence
+found, where INDEX is the position in STRINGS of the string that
+occurs between BEG and END.  Occurrences may overlap.  The list is
+sorted by END, and occurrences that end at the same place are listed
+longest first.  Empty strings never match.
+
+Case is ignored if `case-fold-search' is non-nil in the current buffer.
+
+The buffer is only scanned once, however many strings there are, so
+this is much faster than searching for each string in turn.  It does
+not change the match data or move point.  */)
+  (Lisp_Object strings, Lisp_Object start, Lisp_Object end)
+{
+  struct ac_automaton ac;
+  Lisp_Object trt = (!NILP (BVAR (current_buffer, case_fold_search))
+		     ? BVAR (current_buffer, case_canon_table)
+		     : Qnil);
+  bool multibyte = !NILP (BVAR (current_buffer, enable_multibyte_characters));
+  Lisp_Object result = Qnil;
+  unsigned short int quit_count = 0;
+  ptrdiff_t count = SPECPDL_INDEX ();
+
+  if (!VECTORP (strings))
+    strings = Fvconcat (1, &strings);
+  if (NILP (start))
+    XSETFASTINT (start, BEGV);
+  if (NILP (end))
+    XSETFASTINT (end, ZV);
+  validate_region (&start, &end);
+
+  record_unwind_protect_ptr (xfree, ac_build (&ac, strings, trt));
+
+  ptrdiff_t pos = XFASTINT (start), pos_byte = CHAR_TO_BYTE (pos);
+  ptrdiff_t state = 0;
+  while (pos < XFASTINT (end))
+    {
+      int c;
+      if (multibyte)
+	{
+	  int len;
+	  c = STRING_CHAR_AND_LENGTH (BYTE_POS_ADDR (pos_byte), len);
+	  pos_byte += len;
+	}
+      else
+	{
+	  c = UNIBYTE_TO_CHAR (FETCH_BYTE (pos_byte));
+	  pos_byte++;
+	}
+      pos++;
+      if (!NILP (trt))
+	c = char_table_translate (trt, c);
+
+      state = ac_step (&ac, state, c);
+      for (ptrdiff_t n = ac.out[state] >= 0 ? state : ac.dict[state];
+	   n; n = ac.dict[n])
+	for (ptrdiff_t i = ac.out[n]; i >= 0; i = ac.next_same[i])
+	  result = Fcons (list3 (make_number (i),
+				 make_number (pos - ac.nchars[i]),
+				 make_number (pos)),
+			  result);
+      rarely_quit (++quit_count);
+    }
+
+  return unbind_to (count, Fnreverse (result));
+}
+
 /* Like find_newline, but doesn't use the cache, and only searches forward.  */
 static ptrdiff_t
 find_newline1 (ptrdiff_t start, ptrdiff_t start_byte, ptrdiff_t end,
@@ -3133,23 +3920,6 @@ the buffer.  If the buffer doesn't have a cache, the value is nil.  */)
 void
 syms_of_search (void)
 {
-  register int i;
-
-  for (i = 0; i < REGEXP_CACHE_SIZE; ++i)
-    {
-      searchbufs[i].buf.allocated = 100;
-      searchbufs[i].buf.buffer = xmalloc (100);
-      searchbufs[i].buf.fastmap = searchbufs[i].fastmap;
-      searchbufs[i].regexp = Qnil;
-      searchbufs[i].f_whitespace_regexp = Qnil;
-      searchbufs[i].syntax_table = Qnil;
-      staticpro (&searchbufs[i].regexp);
-      staticpro (&searchbufs[i].f_whitespace_regexp);
-      staticpro (&searchbufs[i].syntax_table);
-      searchbufs[i].next = (i == REGEXP_CACHE_SIZE-1 ? 0 : &searchbufs[i+1]);
-    }
-  searchbuf_head = &searchbufs[0];
-
   /* Error condition used for failing searches.  */
   DEFSYM (Qsearch_failed, "search-failed");
 
@@ -3199,9 +3969,25 @@ do not set the match data.  The proper way to use this variable
 is to bind it with `let' around a small expression.  */);
   Vinhibit_changing_match_data = Qnil;
 
+  DEFVAR_INT ("regexp-cache-size", regexp_cache_size,
+    doc: /* Maximum number of compiled regexps to keep for reuse.
+Searching with a regexp that is in the cache avoids compiling it
+again.  When the cache is full, the least recently used regexp is
+dropped.  Values smaller than 20 are treated as 20.
+See also `regexp-cache-statistics'.  */);
+  regexp_cache_size = 100;
+
+  DEFSYM (QCcapacity, ":capacity");
+  DEFSYM (QChits, ":hits");
+  DEFSYM (QCmisses, ":misses");
+  DEFSYM (QCcompile_time, ":compile-time");
+
   defsubr (&Sreplace_match);
   defsubr (&Smatch_data);
   defsubr (&Sset_match_data);
   defsubr (&Sregexp_quote);
+  defsubr (&Ssearch_strings_in_region);
+  defsubr (&Sbuffer_snapshot_search);
   defsubr (&Snewline_cache_check);
+  defsubr (&Sregexp_cache_statistics);
 }
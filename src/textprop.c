@@ -1321,6 +1321,173 @@ into it.  */)
   return Qnil;
 }
 
+/* Return true if the LEN characters of OBJECT starting at position S,
+   within interval I, all have the properties of PLIST.  */
+
+static bool
+range_has_all_properties (Lisp_Object plist, INTERVAL i,
+			  ptrdiff_t s, ptrdiff_t len)
+{
+  while (interval_has_all_properties (plist, i))
+    {
+      ptrdiff_t got = LENGTH (i) - (s - i->position);
+      if (got >= len)
+	return true;
+      len -= got;
+      s += got;
+      i = next_interval (i);
+    }
+  return false;
+}
+
+/* Add the properties of PLIST to the LEN characters of OBJECT starting
+   at position S, within interval I, splitting intervals as needed.
+   Return true if any property value changed.  */
+
+static bool
+add_properties_to_range (Lisp_Object plist, INTERVAL i,
+			 ptrdiff_t s, ptrdiff_t len, Lisp_Object object)
+{
+  bool modified = false;
+
+  for (;;)
+    {
+      ptrdiff_t got = LENGTH (i) - (s - i->position);
+
+      if (!interval_has_all_properties (plist, i))
+	{
+	  INTERVAL unchanged;
+
+	  if (i->position != s)
+	    {
+	      unchanged = i;
+	      i = split_interval_right (unchanged, s - unchanged->position);
+	      copy_properties (unchanged, i);
+	    }
+	  if (LENGTH (i) > len)
+	    {
+	      unchanged = i;
+	      i = split_interval_left (unchanged, len);
+	      copy_properties (unchanged, i);
+	    }
+	  modified |= add_properties (plist, i, object,
+				      TEXT_PROPERTY_REPLACE);
+	  got = LENGTH (i);
+	}
+
+      if (got >= len)
+	return modified;
+      len -= got;
+      s += got;
+      i = next_interval (i);
+    }
+}
+
+DEFUN ("add-text-property-runs", Fadd_text_property_runs,
+       Sadd_text_property_runs, 1, 2, 0,
+       doc: /* Add properties to several runs of text at once.
+RUNS is a vector of lists (START END PROPERTIES), each meaning to add
+the property list PROPERTIES to the text from START to END, as
+`add-text-properties' does.  The runs must not overlap and must be
+sorted by position.
+
+If the optional second argument OBJECT is a buffer (or nil, which means
+the current buffer), START and END are buffer positions (integers or
+markers).  If OBJECT is a string, START and END are 0-based indices
+into it.
+
+This is equivalent to calling `add-text-properties' on each run, but
+the buffer's change hooks run only once, around the text from the
+start of the first run to the end of the last.
+Return t if any property value actually changed, nil otherwise.  */)
+  (Lisp_Object runs, Lisp_Object object)
+{
+  ptrdiff_t n, k, prev_end, first, last, *bounds;
+  Lisp_Object *plists;
+  bool modified = false;
+  USE_SAFE_ALLOCA;
+
+  CHECK_VECTOR (runs);
+  if (NILP (object))
+    XSETBUFFER (object, current_buffer);
+  CHECK_STRING_OR_BUFFER (object);
+  n = ASIZE (runs);
+
+  /* Check all the runs first, so that an error leaves OBJECT alone.  */
+  SAFE_NALLOCA (bounds, 2, n);
+  SAFE_ALLOCA_LISP (plists, n);
+  prev_end = BUFFERP (object) ? BUF_BEGV (XBUFFER (object)) : 0;
+  for (k = 0; k < n; k++)
+    {
+      Lisp_Object run = AREF (runs, k);
+      Lisp_Object start = Fcar (run), end = Fcar (Fcdr (run));
+
+      CHECK_NUMBER_COERCE_MARKER (start);
+      CHECK_NUMBER_COERCE_MARKER (end);
+      if (! (prev_end <= XINT (start) && XINT (start) <= XINT (end)
+	     && XINT (end) <= (BUFFERP (object)
+			       ? BUF_ZV (XBUFFER (object))
+			       : SCHARS (object))))
+	args_out_of_range (start, end);
+      bounds[2 * k] = XINT (start);
+      bounds[2 * k + 1] = prev_end = XINT (end);
+      plists[k] = validate_plist (Fcar (Fcdr (Fcdr (run))));
+    }
+
+  /* Skip the runs that would change nothing.  */
+  for (first = 0; first < n; first++)
+    {
+      Lisp_Object start = make_number (bounds[2 * first]);
+      Lisp_Object end = make_number (bounds[2 * first + 1]);
+      INTERVAL i;
+
+      if (NILP (plists[first]) || EQ (start, end))
+	continue;
+      i = validate_interval_range (object, &start, &end, soft);
+      if (!i || !range_has_all_properties (plists[first], i, XINT (start),
+					   XINT (end) - XINT (start)))
+	break;
+    }
+  for (last = n; first < last; last--)
+    if (!NILP (plists[last - 1])
+	&& bounds[2 * (last - 1)] < bounds[2 * (last - 1) + 1])
+      break;
+  if (first == last)
+    {
+      SAFE_FREE ();
+      return Qnil;
+    }
+
+  if (BUFFERP (object))
+    modify_text_properties (object, make_number (bounds[2 * first]),
+			    make_number (bounds[2 * last - 1]));
+
+  /* The change hooks may have changed the text, so look the intervals
+     up again, checking the positions anew.  */
+  for (k = first; k < last; k++)
+    {
+      Lisp_Object start = make_number (bounds[2 * k]);
+      Lisp_Object end = make_number (bounds[2 * k + 1]);
+      INTERVAL i;
+
+      if (NILP (plists[k]) || EQ (start, end))
+	continue;
+      i = validate_interval_range (object, &start, &end, hard);
+      if (i)
+	modified |= add_properties_to_range (plists[k], i, XINT (start),
+					     XINT (end) - XINT (start),
+					     object);
+    }
+
+  if (BUFFERP (object))
+    signal_after_change (bounds[2 * first],
+			 bounds[2 * last - 1] - bounds[2 * first],
+			 bounds[2 * last - 1] - bounds[2 * first]);
+
+  SAFE_FREE ();
+  return modified ? Qt : Qnil;
+}
+
 /* Replace properties of text from START to END with new list of
    properties PROPERTIES.  OBJECT is the buffer or string containing
    the text.  OBJECT nil means use the current buffer.
@@ -2366,6 +2533,7 @@ inherits it if NONSTICKINESS is nil.  The `front-sticky' and
   defsubr (&Sput_text_property);
   defsubr (&Sset_text_properties);
   defsubr (&Sadd_face_text_property);
+  defsubr (&Sadd_text_property_runs);
   defsubr (&Sremove_text_properties);
   defsubr (&Sremove_list_of_text_properties);
   defsubr (&Stext_property_any);
@@ -656,6 +656,42 @@ mark_threads (void)
   flush_stack_call_func (mark_threads_callback, NULL);
 }
 
+/* Call FN with DATA on every thread object and on every object that
+   mark_one_thread marks precisely.  Objects that are only referenced
+   from the C stacks are not visited.  */
+
+void
+map_thread_roots (void (*fn) (Lisp_Object, void *), void *data)
+{
+  struct thread_state *iter;
+
+  for (iter = all_threads; iter; iter = iter->next_thread)
+    {
+      Lisp_Object thread_obj;
+
+      XSETTHREAD (thread_obj, iter);
+      fn (thread_obj, data);
+      map_specpdl (iter->m_specpdl, iter->m_specpdl_ptr, fn, data);
+
+      for (struct handler *handler = iter->m_handlerlist;
+	   handler; handler = handler->next)
+	{
+	  fn (handler->tag_or_ch, data);
+	  fn (handler->val, data);
+	}
+
+      if (iter->m_current_buffer)
+	{
+	  Lisp_Object tem;
+	  XSETBUFFER (tem, iter->m_current_buffer);
+	  fn (tem, data);
+	}
+
+      fn (iter->m_last_thing_searched, data);
+      fn (iter->m_saved_last_thing_searched, data);
+    }
+}
+
 
 
 static void
@@ -234,8 +234,9 @@ record_property_change (ptrdiff_t beg, ptrdiff_t length,
 			Lisp_Object prop, Lisp_Object value,
 			Lisp_Object buffer)
 {
-  Lisp_Object lbeg, lend, entry;
+  Lisp_Object lbeg, lend, entry, tail;
   struct buffer *buf = XBUFFER (buffer);
+  int depth;
 
   if (EQ (BVAR (buf, undo_list), Qt))
     return;
@@ -245,6 +246,42 @@ record_property_change (ptrdiff_t beg, ptrdiff_t length,
   if (MODIFF <= SAVE_MODIFF)
     record_first_change ();
 
+  /* Changing a property over text made of many intervals records a
+     change for each of them.  If the same old VALUE of PROP was just
+     recorded for adjacent text, extend that entry instead of adding
+     one.  Entries for other properties can be looked past, since
+     their order relative to this one does not matter; anything else
+     ends the search.  */
+  for (tail = BVAR (current_buffer, undo_list), depth = 0;
+       CONSP (tail) && depth < 8;
+       tail = XCDR (tail), depth++)
+    {
+      Lisp_Object elt = XCAR (tail), rest, range;
+
+      if (! (CONSP (elt) && NILP (XCAR (elt))
+	     && CONSP (rest = XCDR (elt))
+	     && CONSP (XCDR (rest))
+	     && CONSP (range = XCDR (XCDR (rest)))
+	     && INTEGERP (XCAR (range)) && INTEGERP (XCDR (range))))
+	break;
+      if (! EQ (XCAR (rest), prop))
+	continue;
+      if (EQ (XCAR (XCDR (rest)), value))
+	{
+	  if (XINT (XCDR (range)) == beg)
+	    {
+	      XSETCDR (range, make_number (beg + length));
+	      return;
+	    }
+	  if (XINT (XCAR (range)) == beg + length)
+	    {
+	      XSETCAR (range, make_number (beg));
+	      return;
+	    }
+	}
+      break;
+    }
+
   XSETINT (lbeg, beg);
   XSETINT (lend, beg + length);
   entry = Fcons (Qnil, Fcons (prop, Fcons (value, Fcons (lbeg, lend))));
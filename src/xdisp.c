@@ -24760,6 +24760,8 @@ display_count_lines (ptrdiff_t start_byte,
 		}
 	      else
 		{
+		  cursor += skip_newline_blocks (cursor, ceiling_addr - cursor,
+						 &count);
 		  cursor = memchr (cursor, '\n', ceiling_addr - cursor);
 		  if (! cursor)
 		    break;
@@ -24799,6 +24801,11 @@ display_count_lines (ptrdiff_t start_byte,
 		}
 	      else
 		{
+		  ptrdiff_t left = - count;
+		  cursor -= skip_newline_blocks_backward (cursor,
+							  cursor - ceiling_addr,
+							  &left);
+		  count = - left;
 		  cursor = memrchr (ceiling_addr, '\n', cursor - ceiling_addr);
 		  if (! cursor)
 		    break;
@@ -0,0 +1,90 @@
+;;; heap-analyze-tests.el --- Test suite for heap-analyze.
+
+;; Copyright (C) 2018 Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;;
+
+;;; Code:
+
+(require 'ert)
+
+(defconst heap-analyze-tests-program
+  (if installation-directory
+      (expand-file-name "lib-src/heap-analyze" installation-directory)
+    "heap-analyze")
+  "The heap-analyze binary to test.")
+
+(defvar heap-analyze-tests--big nil
+  "A large string that only this variable refers to.")
+
+(ert-deftest heap-analyze-retained-size ()
+  "Check that a symbol retains the memory only its value refers to."
+  (skip-unless (executable-find heap-analyze-tests-program))
+  (let ((file (make-temp-file "heap-snapshot")))
+    (unwind-protect
+        (progn
+          (setq heap-analyze-tests--big (make-string 8000000 ?x))
+          (dump-heap-snapshot file)
+          (with-temp-buffer
+            (should (eq 0 (call-process heap-analyze-tests-program nil t nil
+                                        "-n" "100" file)))
+            (goto-char (point-min))
+            (should (re-search-forward "^[0-9]+ objects, [0-9]+ bytes$"))
+            (should (re-search-forward "^ +[0-9]+ +[0-9]+  string$"))
+            (should (re-search-forward
+                     "^ +\\([0-9]+\\) +[0-9]+  0x[0-9a-f]+ symbol heap-analyze-tests--big$"))
+            (should (>= (string-to-number (match-string 1)) 8000000))))
+      (setq heap-analyze-tests--big nil)
+      (delete-file file))))
+
+(ert-deftest heap-analyze-undo-list ()
+  "Check that a buffer retains what only its undo list refers to."
+  (skip-unless (executable-find heap-analyze-tests-program))
+  (let ((file (make-temp-file "heap-snapshot")))
+    (unwind-protect
+        (with-temp-buffer
+          (buffer-enable-undo)
+          (insert (make-string 4000000 ?y))
+          (undo-boundary)
+          (delete-region (point-min) (point-max))
+          (dump-heap-snapshot file)
+          (with-temp-buffer
+            (should (eq 0 (call-process heap-analyze-tests-program nil t nil
+                                        "-n" "100" file)))
+            (goto-char (point-min))
+            ;; The deleted text now lives only in the undo list, so it
+            ;; counts towards the buffer's retained size but not
+            ;; towards its own size, which includes the gap.
+            (let ((found nil))
+              (while (and (not found)
+                          (re-search-forward
+                           "^ +\\([0-9]+\\) +\\([0-9]+\\)  0x[0-9a-f]+ buffer "
+                           nil t))
+                (when (>= (- (string-to-number (match-string 1))
+                             (string-to-number (match-string 2)))
+                          4000000)
+                  (setq found t)))
+              (should found))))
+      (delete-file file))))
+
+(provide 'heap-analyze-tests)
+;;; heap-analyze-tests.el ends here
@@ -51,3 +51,137 @@
     (should-not (eq x y))
     (dotimes (i 4)
       (should (eql (aref x i) (aref y i))))))
+
+(ert-deftest garbage-collect-statistics-1 ()
+  (garbage-collect)
+  (let ((stats (car (garbage-collect-statistics))))
+    (should (eql (plist-get stats :gc) gcs-done))
+    (should (floatp (plist-get stats :elapsed)))
+    (should (assq 'roots (plist-get stats :phases)))
+    (should (assq 'finalizers (plist-get stats :phases)))
+    (should (integerp (cdr (assq 'conses (plist-get stats :freed)))))
+    (should (natnump (plist-get stats :released)))))
+
+(ert-deftest malloc-trim-1 ()
+  (cl-flet ((last-gc (prop)
+              (plist-get (car (garbage-collect-statistics)) prop)))
+    ;; With a threshold of 0, every collection trims the heap.
+    (let ((gc-trim-threshold 0))
+      (garbage-collect)
+      (should (last-gc :trimmed))
+      (should (natnump (last-gc :released))))
+    ;; With nil, no collection does.
+    (let ((gc-trim-threshold nil))
+      (garbage-collect)
+      (should-not (last-gc :trimmed))
+      (should (= (cdr (assq 'trim (last-gc :phases))) 0)))))
+
+(ert-deftest malloc-trim-strings ()
+  ;; Freeing the data of large strings counts towards the threshold.
+  (let ((gc-trim-threshold (* 4 1024 1024)))
+    (garbage-collect)
+    (let ((s (make-list 64 nil)))
+      (dotimes (i 64)
+        (setcar (nthcdr i s) (make-string 100000 ?x)))
+      (setq s nil))
+    (garbage-collect)
+    (let ((stats (car (garbage-collect-statistics))))
+      (should (>= (plist-get stats :released) (* 32 100000)))
+      (should (plist-get stats :trimmed)))))
+
+(ert-deftest garbage-collect-statistics-log-file ()
+  (let* ((file (make-temp-file "gc-stats"))
+         (gc-statistics-log-file file))
+    (unwind-protect
+        (progn
+          (garbage-collect)
+          (with-temp-buffer
+            (insert-file-contents file)
+            (goto-char (point-min))
+            (should (looking-at "{\"gc\":[0-9]+,"))
+            (should (search-forward "\"freed\":{\"conses\":" nil t))))
+      (delete-file file))))
+
+(ert-deftest dump-heap-snapshot-1 ()
+  (let ((file (make-temp-file "heap-snapshot"))
+        (coding-system-for-read 'binary))
+    (unwind-protect
+        (progn
+          (should (> (dump-heap-snapshot file) 0))
+          (with-temp-buffer
+            (set-buffer-multibyte nil)
+            (insert-file-contents-literally file)
+            (should (string-prefix-p "EHEAPSN1" (buffer-string)))
+            (should (eq (char-before (point-max)) ?E))))
+      (delete-file file))))
+
+(ert-deftest make-float-shared-values ()
+  ;; Compute the values at run time so that the byte compiler cannot
+  ;; fold the calls into one constant.
+  (let* ((three (+ 3 (random 1)))
+         (zero (float (random 1)))
+         (nan (/ zero zero)))
+    ;; The collection empties the cache, so the first call below
+    ;; allocates and the second one must get the same object back.
+    (garbage-collect)
+    (should (eq (float three) (float three)))
+    ;; Only floats with the same bits are shared.
+    (let ((negzero (- zero)))
+      (should-not (eq zero negzero))
+      (should (equal (number-to-string negzero) "-0.0"))
+      (should (equal (number-to-string (* 1.0 zero)) "0.0")))
+    (let ((pos (copysign nan 1.0))
+          (neg (copysign nan -1.0)))
+      (should (eq pos (copysign nan 1.0)))
+      (should-not (eq pos neg))
+      (should (= (copysign 1.0 pos) 1.0))
+      (should (= (copysign 1.0 neg) -1.0)))))
+
+(ert-deftest list-batch-allocation ()
+  ;; Long enough to span several cons blocks.
+  (let* ((n 5000)
+         (l (apply #'list (number-sequence 1 n))))
+    (should (= (length l) n))
+    (should (equal l (number-sequence 1 n))))
+  (should (equal (list 1 2 3) '(1 2 3)))
+  (should (null (list))))
+
+(ert-deftest lazy-sweep-allocate-after-gc ()
+  ;; Mix survivors and garbage in the same blocks, so that the
+  ;; collection leaves blocks that are partly live for lazy sweeping.
+  (let ((keep nil))
+    (dotimes (i 200000)
+      (if (zerop (% i 3))
+          (push (cons i (float i)) keep)
+        (cons i (float i))))
+    (garbage-collect)
+    ;; These come from the unswept blocks, around the survivors.
+    (let ((new (mapcar (lambda (x) (cons (car x) (float (car x)))) keep)))
+      ;; `fset' checks its argument with valid_lisp_object_p.
+      (fset 'alloc-tests--lazy-sweep (cons 'lambda (cons nil new)))
+      (fmakunbound 'alloc-tests--lazy-sweep)
+      (dolist (l (list keep new))
+        (should (= (length l) 66667))
+        (should (cl-every (lambda (x) (= (car x) (cdr x))) l)))
+      (garbage-collect)
+      (should (equal keep new)))))
+
+(ert-deftest garbage-collect-deep-structures ()
+  ;; Each level leaves a cdr on the mark stack, which must grow to hold
+  ;; them all instead of overflowing the C stack.
+  (let ((l nil) (v nil))
+    (dotimes (_ 1000000)
+      (setq l (list l t))
+      (setq v (vector v t)))
+    (garbage-collect)
+    (garbage-collect)
+    (let ((depth 0))
+      (while l
+        (should (eq (cadr l) t))
+        (setq l (car l) depth (1+ depth)))
+      (should (= depth 1000000)))
+    (let ((depth 0))
+      (while v
+        (should (eq (aref v 1) t))
+        (setq v (aref v 0) depth (1+ depth)))
+      (should (= depth 1000000)))))
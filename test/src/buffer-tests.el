@@ -50,4 +50,160 @@ with parameters from the *Messages* buffer modification."
                             (progn (get-buffer-create "nil")
                                    (generate-new-buffer-name "nil")))))
 
+(ert-deftest test-position-bytes-many-markers ()
+  "Char/byte conversion stays exact in a buffer with many markers."
+  (with-temp-buffer
+    ;; Each line is 3 chars and 5 bytes.
+    (dotimes (_ 3000)
+      (insert "\u00e9\u00e9\n"))
+    (let ((markers nil))
+      (dotimes (i 2000)
+        (push (copy-marker (1+ (* 3 (random 3000)))) markers))
+      (dotimes (_ 200)
+        (let ((pos (1+ (* 3 (random 3000)))))
+          (should (= (position-bytes pos) (1+ (* 5 (/ (1- pos) 3)))))
+          (should (= (byte-to-position (position-bytes pos)) pos))))
+      (dolist (m markers)
+        (set-marker m nil)))))
+
+(ert-deftest test-position-bytes-after-edits ()
+  "Char/byte conversion stays exact across edits in a large buffer."
+  (with-temp-buffer
+    (dotimes (i 20000)
+      (insert (if (zerop (% i 7)) "\u65e5\u672c\n" "ab\n")))
+    (let ((check
+           (lambda ()
+             (dotimes (_ 100)
+               (let ((pos (1+ (random (buffer-size)))))
+                 (should (= (position-bytes pos)
+                            (1+ (string-bytes
+                                 (buffer-substring-no-properties 1 pos)))))
+                 (should (= (byte-to-position (position-bytes pos))
+                            pos)))))))
+      (goto-char (point-max))
+      (funcall check)
+      (goto-char 30000)
+      (insert "\u00e9\u00e9\u00e9")
+      (goto-char (point-max))
+      (funcall check)
+      (delete-region 100 5000)
+      (funcall check)
+      (set-buffer-multibyte nil)
+      (set-buffer-multibyte t)
+      (funcall check))))
+
+(ert-deftest test-overlay-recenter-keeps-lists-sorted ()
+  (with-temp-buffer
+    (insert (make-string 2000 ?x))
+    (let ((ovs nil))
+      (dotimes (_ 500)
+        (let ((beg (1+ (random 2000))))
+          (push (make-overlay beg (min 2001 (+ beg (random 100)))) ovs)))
+      (dolist (center '(1 1000 2001 500 1500 1))
+        (overlay-recenter center)
+        (let ((lists (overlay-lists)))
+          (should (= (+ (length (car lists)) (length (cdr lists))) 500))
+          (let ((ends (mapcar #'overlay-end (car lists))))
+            (should (equal ends (sort (copy-sequence ends) #'>=)))
+            (dolist (end ends) (should (<= end center))))
+          (let ((starts (mapcar #'overlay-start (cdr lists))))
+            (should (equal starts (sort (copy-sequence starts) #'<=)))))
+        (dolist (pos '(1 250 999 1000 1001 1999))
+          (let ((count 0))
+            (dolist (ov ovs)
+              (when (and (<= (overlay-start ov) pos)
+                         (< pos (overlay-end ov)))
+                (setq count (1+ count))))
+            (should (= (length (overlays-at pos)) count))))))))
+
+(ert-deftest test-gap-grows-with-buffer ()
+  "Inserting in small pieces makes the gap grow with the buffer."
+  (with-temp-buffer
+    ;; compact_buffer would shrink the gap behind our back.
+    (let ((gc-cons-threshold most-positive-fixnum)
+          (chunk (make-string 100 ?x))
+          (largest 0))
+      (while (< (buffer-size) 1000000)
+        (insert chunk)
+        (should (= (gap-position) (point-max)))
+        ;; Never much more than an eighth of the text...
+        (should (<= (gap-size) (+ 2000 (* 3 (length chunk))
+                                  (/ (buffer-size) 8))))
+        (setq largest (max largest (gap-size))))
+      ;; ...but the last enlargement was in proportion to the text,
+      ;; not just a fixed amount.
+      (should (> largest (/ (buffer-size) 10))))))
+
+(ert-deftest buffer-snapshot-keeps-text ()
+  (let (snap text)
+    (with-temp-buffer
+      (insert "line one\nlínea dos\nline three\n")
+      ;; Leave the gap in the middle of the text.
+      (goto-char 12)
+      (insert "!")
+      (delete-char -1)
+      (setq snap (buffer-snapshot)
+            text (buffer-string))
+      (should (buffer-snapshot-p snap))
+      (should (eq (type-of snap) 'buffer-snapshot))
+      (erase-buffer)
+      (insert "something else"))
+    (garbage-collect)
+    (should (equal (buffer-snapshot-string snap) text))
+    (should (equal (buffer-snapshot-string snap 20 10) (substring text 9 19)))
+    (should-error (buffer-snapshot-string snap 0 3) :type 'args-out-of-range)
+    (should (equal (secure-hash 'sha1 snap) (secure-hash 'sha1 text)))
+    (should (equal (secure-hash 'sha1 snap 10 20)
+                   (secure-hash 'sha1 (substring text 9 19))))))
+
+(ert-deftest buffer-snapshot-unibyte ()
+  (with-temp-buffer
+    (set-buffer-multibyte nil)
+    (insert "\377\000abc")
+    (let ((snap (buffer-snapshot)))
+      (should (equal (secure-hash 'md5 snap) (secure-hash 'md5 (buffer-string))))
+      (should (equal (buffer-snapshot-search "abc" snap) '(3 6)))
+      (should (equal (buffer-snapshot-string snap 1 2) "\377")))))
+
+(ert-deftest buffer-snapshot-search ()
+  (with-temp-buffer
+    (insert "abc línea 12 xyz 345")
+    (narrow-to-region 3 (point-max))
+    (let ((snap (buffer-snapshot)))
+      (widen)
+      (erase-buffer)
+      (string-match "b" "ab")
+      ;; Positions are those the text had in the buffer.
+      (should (equal (buffer-snapshot-search "\\([0-9]+\\) \\(q\\)?\\(x\\)" snap)
+                     '(11 15 11 13 nil nil 14 15)))
+      (should (equal (buffer-snapshot-search "[0-9]+" snap 13) '(18 21)))
+      (should-not (buffer-snapshot-search "abc" snap))
+      (should-error (buffer-snapshot-search "a" snap 1)
+                    :type 'args-out-of-range)
+      (let ((case-fold-search t))
+        (should (equal (buffer-snapshot-search "LÍNEA" snap) '(5 10))))
+      (let ((case-fold-search nil))
+        (should-not (buffer-snapshot-search "LÍNEA" snap)))
+      ;; The match data is left alone.
+      (should (equal (match-data) '(1 2))))))
+
+(ert-deftest buffer-snapshot-large-multibyte ()
+  ;; Long enough for the snapshot to use checkpoints from the charpos
+  ;; index, and narrowed so that they are not at its start.
+  (with-temp-buffer
+    (dotimes (i 5000)
+      (insert (format "%d %s\n" i
+                      (make-string (% i 17) (if (= (% i 2) 1) ?é ?x)))))
+    (narrow-to-region 1000 (- (point-max) 1000))
+    (let ((snap (buffer-snapshot))
+          (text (buffer-string)))
+      (dolist (pos (list (point-min) 5000 30000 (- (point-max) 50)))
+        (should (equal (buffer-snapshot-string snap pos (+ pos 50))
+                       (buffer-substring pos (+ pos 50)))))
+      (should (equal (buffer-snapshot-string snap) text))
+      (let ((needle (buffer-substring 60000 60040)))
+        (should (equal (buffer-snapshot-search (regexp-quote needle) snap
+                                               50000)
+                       '(60000 60040)))))))
+
 ;;; buffer-tests.el ends here
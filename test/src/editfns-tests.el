@@ -253,4 +253,23 @@
                  (buffer-string)
                  "foo bar baz qux"))))))
 
+;; Line motion over many short lines counts newlines a block at a time.
+(ert-deftest editfns-tests--forward-line-many-lines ()
+  (with-temp-buffer
+    (let ((starts (list 1)))
+      (dotimes (i 20000)
+        (insert (make-string (% (* i 13) 11) ?x) "\n")
+        (push (point) starts))
+      (setq starts (vconcat (nreverse starts)))
+      (let ((nlines (1- (length starts))))
+        (dolist (from '(0 1 70 9999 19990 20000))
+          (dolist (delta '(1 -1 65 -65 100 -100 5000 -5000 30000 -30000))
+            (let ((to (max 0 (min nlines (+ from delta)))))
+              (goto-char (aref starts from))
+              (should (= (forward-line delta) (- (+ from delta) to)))
+              (should (= (point) (aref starts to))))))
+        (should (= (count-lines (point-min) (point-max)) nlines))
+        (should (= (count-lines (aref starts 123) (aref starts 17000))
+                   (- 17000 123)))))))
+
 ;;; editfns-tests.el ends here
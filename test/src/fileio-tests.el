@@ -97,3 +97,26 @@ Also check that an encoding error can appear in a symlink."
   (should (equal (file-name-as-directory "d:/abc/") "d:/abc/"))
   (should (equal (file-name-as-directory "D:\\abc/") "d:/abc/"))
   (should (equal (file-name-as-directory "D:/abc//") "d:/abc//")))
+
+(ert-deftest fileio-tests--insert-large-file ()
+  "Insert a file larger than the chunks it is read in, whole and in part."
+  (let ((file (make-temp-file "fileio-tests"))
+        (coding-system-for-read 'utf-8-unix)
+        (coding-system-for-write 'utf-8-unix)
+        text)
+    (unwind-protect
+        (progn
+          ;; 2.4 MB, so that the text spans several 1 MiB reads.
+          (with-temp-buffer
+            (dotimes (i 300000)
+              (insert (format "%07d\n" i)))
+            (setq text (buffer-string))
+            (write-region nil nil file nil 'silent))
+          (with-temp-buffer
+            (insert-file-contents file)
+            (should (equal (buffer-string) text)))
+          ;; A range that starts and ends in the middle of a read.
+          (with-temp-buffer
+            (insert-file-contents file nil 1000003 2500007)
+            (should (equal (buffer-string) (substring text 1000003 2500007)))))
+      (delete-file file))))
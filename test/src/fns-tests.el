@@ -575,4 +575,68 @@
                                :type 'wrong-type-argument)
                  '(wrong-type-argument plistp (:foo 1 . :bar)))))
 
+;; The line index only kicks in past a few strides of 4096 bytes, so
+;; use a buffer well beyond that, with lines of varying length and some
+;; multibyte text.
+(ert-deftest fns-tests-line-number-at-pos ()
+  (with-temp-buffer
+    (dotimes (i 3000)
+      (insert (make-string (% (* i 7) 23) (if (zerop (% i 5)) ?é ?x)) "\n"))
+    (let ((check
+           (lambda ()
+             (dolist (pos (list (point-min) (1+ (point-min)) 5000 20000
+                                (/ (point-max) 2) (1- (point-max))
+                                (point-max)))
+               (when (<= (point-min) pos (point-max))
+                 (should (= (line-number-at-pos pos)
+                            (1+ (cl-count ?\n (buffer-substring
+                                               (point-min) pos)))))
+                 (should (= (line-number-at-pos pos t)
+                            (save-restriction
+                              (widen)
+                              (1+ (cl-count ?\n (buffer-substring
+                                                 (point-min) pos)))))))))))
+      (funcall check)
+      ;; Edits must not leave stale counts behind.
+      (goto-char 10000)
+      (insert "a\nb\nc\n")
+      (funcall check)
+      (goto-char 3000)
+      (delete-region 3000 3500)
+      (funcall check)
+      (subst-char-in-region 100 2000 ?\n ?\s)
+      (funcall check)
+      (save-restriction
+        (narrow-to-region 4000 30000)
+        (funcall check))
+      ;; forward-line over many lines lands on the right one.
+      (goto-char (point-min))
+      (should (= (forward-line 2000) 0))
+      (should (bolp))
+      (should (= (line-number-at-pos) 2001))
+      (goto-char (point-min))
+      (should (= (forward-line 100000)
+                 (- 100000 (count-lines (point-min) (point-max))))))))
+
+(ert-deftest fns-tests-line-number-at-pos-multibyte-toggle ()
+  ;; Switching multibyteness changes every character position, so the
+  ;; line index must not survive it.
+  (with-temp-buffer
+    (dotimes (i 3000)
+      (insert (make-string (% (* i 7) 23) (if (zerop (% i 3)) ?é ?x)) "\n"))
+    (let ((check
+           (lambda ()
+             (dolist (pos (list 5000 20000 (/ (point-max) 2) (point-max)))
+               (should (= (line-number-at-pos pos)
+                          (1+ (cl-count ?\n (buffer-substring
+                                             (point-min) pos))))))
+             (goto-char (point-min))
+             (should (= (forward-line 2000) 0))
+             (should (= (line-number-at-pos) 2001)))))
+      (funcall check)
+      (set-buffer-multibyte nil)
+      (funcall check)
+      (set-buffer-multibyte t)
+      (funcall check))))
+
 (provide 'fns-tests)
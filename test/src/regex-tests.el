@@ -683,4 +683,67 @@ This evaluates the TESTS test cases from glibc."
   (should-not (string-match "\\`x\\{65535\\}" (make-string 65534 ?x)))
   (should-error (string-match "\\`x\\{65536\\}" "X") :type 'invalid-regexp))
 
+(ert-deftest regex-literal-prefix-search ()
+  "Test searches for patterns that start with a literal string."
+  (with-temp-buffer
+    (dotimes (_ 200)
+      (insert "ERROR: no timeout; an ERROR: with (defun foo) here\n"))
+    (insert "ERROR: late timeout\né-ERROR: ü\n")
+    ;; Put the gap in the middle of the next to last occurrence.
+    (goto-char (- (point-max) 28))
+    (insert "x")
+    (delete-char -1)
+    (let ((case-fold-search nil))
+      (goto-char (point-min))
+      (should (re-search-forward "^ERROR: .*late timeout" nil t))
+      (should (= (match-beginning 0) (- (point-max) 31)))
+      (goto-char (point-min))
+      (should (re-search-forward "\\_<defun foo\\_>" nil t))
+      (should (= (match-beginning 0) 36))
+      (goto-char (point-min))
+      (should (re-search-forward "\\(ERROR: \\)ü" nil t))
+      (should (equal (match-string 1) "ERROR: "))
+      (goto-char (point-min))
+      (should-not (re-search-forward "ERROR: x" nil t))
+      (goto-char (point-min))
+      (should-not (re-search-forward "ERROR: late" (- (point-max) 34) t))
+      ;; Case folding does not use the literal prefix.
+      (let ((case-fold-search t))
+        (goto-char (point-min))
+        (should (re-search-forward "error: late" nil t))))
+    (should (string-match "ab\\(c\\)" "xxabxabc"))
+    (should (= (match-beginning 0) 5))))
+
+(ert-deftest regex-dfa-search ()
+  "Test searches that first ask the DFA where a match can start."
+  ;; Backtracking alone takes time exponential in the length of the
+  ;; text to find that these do not match.
+  (let ((text (make-string 40 ?a)))
+    (should-not (string-match "\\(a*\\)*b" text))
+    (should-not (string-match-p "\\(?:a\\|aa\\)*c" text))
+    (should (eql (string-match-p "\\(?:a\\|aa\\)*c" (concat text "c")) 0))
+    (with-temp-buffer
+      (insert text "\n" text "b")
+      (goto-char (point-min))
+      (should-not (looking-at "\\(a*\\)*b"))
+      (should (re-search-forward "\\(a*\\)*b" nil t))
+      (should (= (match-beginning 0) 42))
+      (should (= (match-end 0) (point-max)))
+      (should (re-search-backward "\\(a*\\)*b" nil t))
+      (should (= (match-beginning 0) (1- (point-max))))))
+  ;; Anchors, case folding and multibyte text.
+  (should (eql (string-match "^b\\|c$" "ab\nc") 3))
+  (should (eql (string-match "\\`b\\|b\\'" "ab\nab") 4))
+  (should (eql (string-match "\\(?:b\\|a\\'\\)$" "a\nab\na") 3))
+  (let ((case-fold-search t))
+    (should (eql (string-match "É\\(x\\|ü\\)+$" "aéüÜ\nb") 1))
+    (should (equal (match-string 1 "aéüÜ\nb") "Ü")))
+  ;; Classes that depend on the syntax table are looked up at each
+  ;; search.
+  (with-syntax-table (make-syntax-table)
+    (modify-syntax-entry ?é " ")
+    (should (eql (string-match "a[[:space:]]b" "xaéb") 1))
+    (modify-syntax-entry ?é "w")
+    (should-not (string-match "a[[:space:]]b" "xaéb"))))
+
 ;;; regex-tests.el ends here
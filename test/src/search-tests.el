@@ -0,0 +1,112 @@
+;;; search-tests.el --- tests for search.c functions -*- lexical-binding: t -*-
+
+;; Copyright (C) 2018 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+(eval-when-compile (require 'cl-lib))
+
+(ert-deftest search-strings-in-region ()
+  (with-temp-buffer
+    (insert "she sells seashells; he shelled ushers")
+    (let ((case-fold-search nil))
+      (should (equal (search-strings-in-region '("he" "she" "his" "hers"))
+                     '((1 1 4) (0 2 4) (1 14 17) (0 15 17)
+                       (0 22 24) (1 25 28) (0 26 28)
+                       (1 34 37) (0 35 37) (3 35 39))))
+      ;; Vectors, bounds, duplicates and empty strings.
+      (should (equal (search-strings-in-region ["sh" "" "sh"] 10 20)
+                     '((0 14 16) (2 14 16))))
+      (should-not (search-strings-in-region '("xyz" "")))
+      (should-not (search-strings-in-region nil))
+      (should-error (search-strings-in-region '("a" 1)))
+      (should-error (search-strings-in-region '("a") 1 100)))
+    ;; Case folding, multibyte text and the gap.
+    (erase-buffer)
+    (insert "Émile ÉMILE émile")
+    (goto-char 8)
+    (insert "x")
+    (delete-char -1)
+    (let ((case-fold-search t))
+      (should (equal (search-strings-in-region '("émile"))
+                     '((0 1 6) (0 7 12) (0 13 18)))))
+    (let ((case-fold-search nil))
+      (should (equal (search-strings-in-region '("émile"))
+                     '((0 13 18)))))
+    ;; Unibyte buffers.
+    (set-buffer-multibyte nil)
+    (let ((case-fold-search nil))
+      (should (equal (search-strings-in-region '("MILE"))
+                     '((0 10 14)))))))
+
+;; Case-folded searches for strings whose non-ASCII characters have case
+;; variants in different blocks can't use Boyer-Moore.
+(ert-deftest search-forward-case-fold-multibyte ()
+  (with-temp-buffer
+    (dotimes (_ 50)
+      (insert "alpha beta gamma "))
+    (insert "Ωmega ωMEGA")
+    ;; Put the gap inside the last occurrence.
+    (goto-char (- (point-max) 3))
+    (insert "x")
+    (delete-char -1)
+    (let ((case-fold-search t))
+      (goto-char (point-min))
+      (should (search-forward "ωmega" nil t))
+      (should (= (match-beginning 0) (- (point-max) 11)))
+      (should (search-forward "ωmega" nil t))
+      (should (= (match-beginning 0) (- (point-max) 5)))
+      (should (= (point) (point-max)))
+      (should-not (search-forward "ωmega" nil t))
+      (goto-char (point-min))
+      (should-not (search-forward "ωmegb" nil t))
+      (should (search-forward "GAMMA Ω" nil t))
+      (should (= (match-end 0) (- (point-max) 10)))
+      (goto-char (point-max))
+      (should (search-backward "ΩMEGA" nil t))
+      (should (= (point) (- (point-max) 5)))
+      (should (search-backward "ΩMEGA" nil t))
+      (should (= (point) (- (point-max) 11))))
+    (let ((case-fold-search nil))
+      (goto-char (point-min))
+      (should (search-forward "ωMEGA" nil t))
+      (should (= (match-beginning 0) (- (point-max) 5))))))
+
+;; Each regexp is compiled once while it stays in the cache.
+(ert-deftest regexp-cache-statistics ()
+  (let ((regexp-cache-size 20)
+        ;; Regexps that no earlier run has left in the cache.
+        (regexps (mapcar (lambda (i) (format "search-tests-%d-%s" i (random)))
+                         (number-sequence 0 29))))
+    (cl-flet ((stat (prop) (plist-get (regexp-cache-statistics) prop)))
+      (let ((misses (stat :misses)))
+        (dolist (regexp regexps)
+          (string-match regexp ""))
+        (should (= (stat :misses) (+ misses 30))))
+      (let ((hits (stat :hits)))
+        (string-match (nth 29 regexps) "")
+        (should (= (stat :hits) (1+ hits))))
+      (let ((misses (stat :misses)))
+        (string-match (nth 0 regexps) "")
+        (should (= (stat :misses) (1+ misses))))
+      (should (<= (stat :size) (stat :capacity) 20))
+      (should (floatp (stat :compile-time))))))
+
+(provide 'search-tests)
+;;; search-tests.el ends here
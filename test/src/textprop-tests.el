@@ -68,5 +68,41 @@
     (should (and (equal-including-properties (pop stack) string)
 		 (null stack)))))
 
+(ert-deftest textprop-tests-add-text-property-runs ()
+  "Test that `add-text-property-runs' acts like `add-text-properties'."
+  (let ((runs [(1 4 (face bold)) (4 4 (face italic)) (6 9 (a 1 b 2))
+               (12 20 (face italic))])
+        (calls 0))
+    (with-temp-buffer
+      (insert "0123456789abcdefghijklmnop")
+      (put-text-property 7 14 'a 0)
+      (let ((expected (with-temp-buffer
+                        (insert "0123456789abcdefghijklmnop")
+                        (put-text-property 7 14 'a 0)
+                        (mapc (lambda (run) (apply #'add-text-properties run))
+                              runs)
+                        (buffer-string))))
+        (add-hook 'after-change-functions
+                  (lambda (beg end _len)
+                    (setq calls (1+ calls))
+                    (should (equal (list beg end) '(1 20))))
+                  nil t)
+        (should (eq (add-text-property-runs runs) t))
+        (should (= calls 1))
+        (should (equal-including-properties (buffer-string) expected))
+        ;; Nothing left to change.
+        (should-not (add-text-property-runs runs))
+        (should (= calls 1))))
+    ;; Strings use 0-based indices.
+    (let ((string (copy-sequence "abcdef")))
+      (add-text-property-runs [(0 2 (x 1)) (3 6 (y 2))] string)
+      (should (equal-including-properties
+               string #("abcdef" 0 2 (x 1) 3 6 (y 2)))))
+    ;; Unsorted or overlapping runs are rejected before any change.
+    (with-temp-buffer
+      (insert "abcdef")
+      (should-error (add-text-property-runs [(3 5 (x 1)) (1 4 (x 2))]))
+      (should-not (next-property-change (point-min))))))
+
 (provide 'textprop-tests)
 ;; textprop-tests.el ends here.
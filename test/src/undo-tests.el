@@ -466,5 +466,23 @@ Demonstrates bug 25599."
     (undo-boundary)
     (undo)))
 
+(ert-deftest undo-test-property-change-merged ()
+  "Test that changing a property over many intervals makes one entry."
+  (with-temp-buffer
+    (buffer-enable-undo)
+    (insert (make-string 100 ?a))
+    (dotimes (i 20)
+      (put-text-property (+ 1 (* i 5)) (+ 3 (* i 5)) 'bar i))
+    (undo-boundary)
+    (let ((before (buffer-string)))
+      (setq buffer-undo-list nil)
+      (put-text-property (point-min) (point-max) 'foo t)
+      (should (equal buffer-undo-list '((nil foo nil 1 . 101))))
+      ;; Different old values stay separate entries.
+      (put-text-property (point-min) (point-max) 'bar 'x)
+      (should (= 41 (length buffer-undo-list)))
+      (primitive-undo 1 buffer-undo-list)
+      (should (equal-including-properties (buffer-string) before)))))
+
 (provide 'undo-tests)
 ;;; undo-tests.el ends here